@@ -0,0 +1,144 @@
+#include "allocator.h"
+#include "global.h"
+#include <QtCore/QtCore>
+#include <cstdio>
+using namespace cpi;
+
+#ifdef Q_OS_DARWIN
+const QString PreloadVariable = "DYLD_INSERT_LIBRARIES";
+const QString LibrarySuffix = ".dylib";
+#else
+const QString PreloadVariable = "LD_PRELOAD";
+const QString LibrarySuffix = ".so";
+#endif
+
+
+// pkg-config module and library of the allocators
+static const QMap<QString, QPair<QString, QString>> &knownAllocators()
+{
+    static const QMap<QString, QPair<QString, QString>> allocators {
+        {"jemalloc", {"jemalloc", "libjemalloc"}},
+        {"mimalloc", {"mimalloc", "libmimalloc"}},
+        {"tcmalloc", {"libtcmalloc", "libtcmalloc"}},
+    };
+    return allocators;
+}
+
+
+static QString pkgConfigLibdir(const QString &module)
+{
+    QProcess proc;
+    proc.start("pkg-config", {"--variable=libdir", module});
+    if (!proc.waitForFinished() || proc.exitCode() != 0) {
+        return QString();
+    }
+    return QString::fromLocal8Bit(proc.readAllStandardOutput().trimmed());
+}
+
+
+// libjemalloc.so, libjemalloc.so.2 or libjemalloc.2.dylib
+static QString findLibrary(const QString &dirPath, const QString &baseName)
+{
+    if (dirPath.isEmpty()) {
+        return QString();
+    }
+
+    QDir dir(dirPath);
+    const QStringList names = dir.entryList({baseName + LibrarySuffix, baseName + LibrarySuffix + ".*", baseName + ".*" + LibrarySuffix}, QDir::Files, QDir::Name);
+    return names.isEmpty() ? QString() : dir.absoluteFilePath(names.first());
+}
+
+
+Allocator::Allocator(const QString &spec)
+{
+    for (const auto &item : spec.split(QRegularExpression("[\\s,]+"), SkipEmptyParts)) {
+        if (item.compare("thp", Qt::CaseInsensitive) == 0) {
+            _thp = true;
+        } else if (item != "default" && item != "system") {
+            _name = item;
+        }
+    }
+}
+
+
+// Finds the shared library by pkg-config or in the known directories
+bool Allocator::resolve()
+{
+    static QHash<QString, QString> resolved;  // name -> path
+
+    if (isEmpty()) {
+        return true;
+    }
+
+    if (QFileInfo(_name).isAbsolute()) {
+        _library = QFileInfo(_name).isFile() ? _name : QString();
+    } else if (resolved.contains(_name)) {
+        _library = resolved.value(_name);
+        return !_library.isEmpty();  // already warned
+    } else if (knownAllocators().contains(_name)) {
+        const auto &[module, baseName] = knownAllocators().value(_name);
+        QStringList dirs = {pkgConfigLibdir(module), conf->value("ALLOCATOR_LIBDIR").toString()};
+#ifdef Q_OS_DARWIN
+        dirs << "/opt/homebrew/lib" << "/usr/local/lib";
+#else
+        dirs << "/usr/lib/x86_64-linux-gnu" << "/usr/lib/aarch64-linux-gnu" << "/usr/lib64" << "/usr/lib" << "/usr/local/lib";
+#endif
+        for (const auto &dir : dirs) {
+            _library = findLibrary(dir, baseName);
+            if (!_library.isEmpty()) {
+                break;
+            }
+        }
+    }
+    resolved.insert(_name, _library);
+
+    if (_library.isEmpty()) {
+        std::fprintf(stderr, ">>> allocator '%s' not found, uses the default malloc\n", qUtf8Printable(_name));
+        std::fflush(stderr);
+        return false;
+    }
+    return true;
+}
+
+
+// Environment of the executed program with the allocator preloaded
+QStringList Allocator::environment() const
+{
+    auto env = QProcessEnvironment::systemEnvironment();
+    if (_library.isEmpty()) {
+        return env.toStringList();
+    }
+
+    QString preload = env.value(PreloadVariable);
+    env.insert(PreloadVariable, preload.isEmpty() ? _library : _library + ":" + preload);
+
+    if (_thp) {
+        if (_name.contains("mimalloc")) {
+            env.insert("MIMALLOC_ALLOW_LARGE_OS_PAGES", "1");
+        } else if (_name.contains("jemalloc")) {
+            QString mallocConf = env.value("MALLOC_CONF");
+            env.insert("MALLOC_CONF", (mallocConf.isEmpty() ? QString() : mallocConf + ",") + "thp:always,metadata_thp:auto");
+        }
+    }
+    return env.toStringList();
+}
+
+
+QString Allocator::toString() const
+{
+    if (_library.isEmpty()) {
+        return "default";
+    }
+    return _name + " (" + _library + (_thp ? ", thp" : "") + ")";
+}
+
+
+// ALLOCATOR and ALLOCATOR_THP of the INI file
+QString Allocator::fromConfig()
+{
+    QString spec = conf->value("ALLOCATOR").toString();
+    if (conf->value("ALLOCATOR_THP", false).toBool()) {
+        spec += " thp";
+    }
+    return spec;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+
+
+// Replacement of malloc preloaded into the executed program,
+// e.g. "jemalloc" or "mimalloc thp"
+class Allocator {
+public:
+    explicit Allocator(const QString &spec = QString());
+
+    bool isEmpty() const { return _name.isEmpty(); }
+    QString name() const { return _name; }
+    QString libraryPath() const { return _library; }
+    bool resolve();
+    QStringList environment() const;
+    QString toString() const;
+    static QString fromConfig();
+
+private:
+    QString _name;
+    QString _library;  // path of the shared library
+    bool _thp {false};  // transparent hugepages
+};
@@ -0,0 +1,242 @@
+#include "asmviewer.h"
+#include "compiler.h"
+#include "global.h"
+#include "print.h"
+#include <QtCore/QtCore>
+using namespace cpi;
+
+
+static QString demangle(const QString &text)
+{
+    QProcess proc;
+    proc.start("c++filt", QStringList());
+    if (!proc.waitForStarted()) {
+        return text;
+    }
+    proc.write(text.toLocal8Bit());
+    proc.closeWriteChannel();
+    proc.waitForFinished(-1);
+    return (proc.exitCode() == 0) ? QString::fromLocal8Bit(proc.readAllStandardOutput()) : text;
+}
+
+
+AsmViewer::AsmViewer(const QString &cc, const QStringList &options) :
+    _cc(cc), _options(options)
+{
+}
+
+
+// Compiles the source read from stdin at the optimization level, "O2" or "-O2";
+// the lines of the source are numbered from 1 to lineCount by #line directives
+bool AsmViewer::generate(const QString &source, int lineCount, const QString &level, bool ir)
+{
+    QStringList opts = _options;
+    if (!level.isEmpty()) {
+        opts << (level.startsWith('-') ? level : "-" + level);  // the last one wins
+    }
+
+    if (ir) {
+        if (!Compiler::isClang(_cc)) {
+            print() << "LLVM IR requires clang" << endl;
+            return false;
+        }
+        opts << "-S" << "-emit-llvm" << "-g0" << "-fno-discard-value-names";
+    } else {
+        opts << "-S" << "-g" << "-fno-asynchronous-unwind-tables";
+    }
+
+    QProcess proc;
+    proc.start(_cc, opts << "-o" << "-" << "-");
+    proc.write(source.toLocal8Bit() + "\n");
+    proc.closeWriteChannel();
+    proc.waitForFinished(-1);
+
+    if (proc.exitStatus() != QProcess::NormalExit || proc.exitCode() != 0) {
+        print() << QString::fromLocal8Bit(proc.readAllStandardError()) << flush;
+        return false;
+    }
+
+    const QString output = QString::fromLocal8Bit(proc.readAllStandardOutput());
+    if (ir) {
+        filterIR(output);
+    } else {
+        filterAssembly(output, lineCount);
+    }
+    return true;
+}
+
+
+// Demangles the symbols of all the lines at once
+void AsmViewer::setLines(const QList<Line> &lines)
+{
+    QStringList texts;
+    for (const auto &l : lines) {
+        texts << l.text;
+    }
+
+    const QStringList demangled = demangle(texts.join('\n') + '\n').split('\n');
+    _lines = lines;
+    for (int i = 0; i < _lines.count(); i++) {
+        _lines[i].text = demangled.value(i, _lines[i].text);
+    }
+}
+
+
+// Keeps the instructions located at the lines of the source, and the
+// labels they refer to
+void AsmViewer::filterAssembly(const QString &assembly, int lineCount)
+{
+    static const QRegularExpression reFile("^\\.file\\s+(\\d+)\\s+\"([^\"]*)\"(?:\\s+\"([^\"]*)\")?");
+    static const QRegularExpression reLoc("^\\.loc\\s+(\\d+)\\s+(\\d+)");
+    static const QRegularExpression reSymbol("^([A-Za-z_$][\\w$.@]*):");
+    static const QRegularExpression reLabel("^(\\.L\\w+):");
+    static const QRegularExpression reLabelRef("\\.L\\w+");
+
+    QList<Line> result;
+    QList<Line> function;
+    QString symbol;
+    QStringList sourceFiles;  // numbers of the files of the source
+    int currentFile = -1;
+    int currentLine = 0;
+    bool located = false;  // the function has an instruction of the source
+
+    auto flush = [&]() {
+        if (located) {
+            // labels referred by the kept instructions
+            QSet<QString> refs;
+            for (const auto &l : function) {
+                if (!l.text.endsWith(':')) {
+                    auto it = reLabelRef.globalMatch(l.text);
+                    while (it.hasNext()) {
+                        refs << it.next().captured(0);
+                    }
+                }
+            }
+
+            result << Line {symbol + ":", -1};
+            for (const auto &l : function) {
+                if (!l.text.endsWith(':') || refs.contains(l.text.chopped(1))) {
+                    result << l;
+                }
+            }
+        }
+        function.clear();
+        located = false;
+    };
+
+    for (const auto &raw : assembly.split('\n')) {
+        const QString line = raw.trimmed();
+        if (line.isEmpty() || line.startsWith('#') || line.startsWith("//")) {
+            continue;
+        }
+
+        auto match = reFile.match(line);
+        if (match.hasMatch()) {
+            QString name = match.captured(3).isEmpty() ? match.captured(2) : match.captured(3);
+            if (name == "<stdin>" || name == "-") {
+                sourceFiles << match.captured(1);
+            }
+            continue;
+        }
+
+        match = reLoc.match(line);
+        if (match.hasMatch()) {
+            currentFile = sourceFiles.contains(match.captured(1)) ? match.captured(1).toInt() : -1;
+            currentLine = match.captured(2).toInt();
+            continue;
+        }
+
+        if (!raw.at(0).isSpace()) {
+            match = reSymbol.match(line);
+            if (match.hasMatch() && !line.startsWith(".L")) {
+                flush();  // a new function
+                symbol = match.captured(1);
+                continue;
+            }
+
+            match = reLabel.match(line);
+            if (match.hasMatch()) {
+                function << Line {match.captured(1) + ":", 0};
+                continue;
+            }
+        }
+
+        if (line.startsWith('.')) {
+            continue;  // directive
+        }
+
+        if (currentFile >= 0 && currentLine >= 1 && currentLine <= lineCount) {
+            function << Line {line.section('#', 0, 0).trimmed().replace('\t', ' '), currentLine};
+            located = true;
+        }
+    }
+    flush();
+    setLines(result);
+}
+
+
+// Keeps the functions defined in the source, not instantiated from headers
+void AsmViewer::filterIR(const QString &ir)
+{
+    static const QRegularExpression reAttributes("\\s*#\\d+\\s*\\{$");
+    static const QRegularExpression reDebug(", !\\w+ !\\d+");
+
+    QList<Line> result;
+    bool inFunction = false;
+    bool skip = false;
+
+    for (const auto &line : ir.split('\n')) {
+        if (line.startsWith("define ")) {
+            inFunction = true;
+            skip = line.contains("linkonce_odr") || line.contains("_GLOBAL__sub_I") || line.contains("__cxx_global_var_init");
+        }
+
+        if (inFunction && !skip) {
+            QString text = QString(line).remove(reDebug);
+            if (line.startsWith("define ")) {
+                result << Line {text.remove(reAttributes) + " {", -1};
+            } else {
+                result << Line {text, 0};
+            }
+        }
+
+        if (line.startsWith('}')) {
+            inFunction = false;
+        }
+    }
+    setLines(result);
+}
+
+
+// Prints the code annotated with the lines numbered from 1
+void AsmViewer::printReport(const QStringList &lines) const
+{
+    if (_lines.isEmpty()) {
+        print() << "No code generated" << endl;
+        return;
+    }
+
+    int lastLine = 0;
+    for (int i = 0; i < _lines.count(); i++) {
+        const auto &l = _lines[i];
+        if (l.sourceLine < 0) {
+            if (i > 0) {
+                print() << endl;
+            }
+            print() << l.text << endl;  // function
+            lastLine = 0;
+            continue;
+        }
+
+        if (l.sourceLine > 0 && l.sourceLine != lastLine) {
+            print() << QString("%1| ").arg(l.sourceLine, 4) << lines.value(l.sourceLine - 1).trimmed() << endl;
+            lastLine = l.sourceLine;
+        }
+
+        if (l.text.endsWith(':') || l.sourceLine == 0) {
+            print() << l.text << endl;  // label or IR
+        } else {
+            print() << "        " << l.text << endl;
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+
+// Shows the assembly (or LLVM IR) generated for the lines of a source,
+// without the code of headers and of cpi, annotated with the lines
+class AsmViewer {
+public:
+    AsmViewer(const QString &cc, const QStringList &options);
+
+    bool generate(const QString &source, int lineCount, const QString &level = QString(), bool ir = false);
+    void printReport(const QStringList &lines) const;
+
+private:
+    struct Line {
+        QString text;
+        int sourceLine {0};  // line of the source, 0 if not annotated, -1 for a function
+    };
+
+    void filterAssembly(const QString &assembly, int lineCount);
+    void filterIR(const QString &ir);
+    void setLines(const QList<Line> &lines);
+
+    QString _cc;
+    QStringList _options;
+    QList<Line> _lines;
+};
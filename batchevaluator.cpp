@@ -0,0 +1,211 @@
+#include "batchevaluator.h"
+#include "codegenerator.h"
+#include "compiler.h"
+#include "global.h"
+#include "print.h"
+#include <QtCore/QtCore>
+#include <algorithm>
+using namespace cpi;
+
+constexpr int SnippetTimeout = 10000;  // msecs
+
+
+int BatchEvaluator::run(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        print() << "File open error, " << path << endl;
+        return 1;
+    }
+
+    // {"id": ..., "code": "...", "headers": "..." or [...]}
+    QList<int> valid;
+    for (const auto &line : file.readAll().split('\n')) {
+        if (line.trimmed().isEmpty()) {
+            continue;
+        }
+
+        Snippet snippet;
+        QJsonObject obj = QJsonDocument::fromJson(line).object();
+        snippet.id = obj.value("id");
+        snippet.code = obj.value("code").toString();
+
+        QJsonValue headers = obj.value("headers");
+        if (headers.isArray()) {
+            for (const auto &h : headers.toArray()) {
+                snippet.headers << h.toString();
+            }
+        } else {
+            snippet.headers = headers.toString().split("\n", SkipEmptyParts);
+        }
+
+        if (snippet.code.trimmed().isEmpty()) {
+            snippet.status = "invalid";
+            snippet.error = "no code";
+        } else if (snippet.code.contains(QRegularExpression(" main\\s*\\("))) {
+            snippet.status = "invalid";
+            snippet.error = "main function is not supported";
+        } else {
+            valid << _snippets.count();
+        }
+        _snippets << snippet;
+    }
+
+    // one binary for the snippets of the same headers, not to leak the
+    // includes, using directives and macros of a snippet into the others
+    QList<QList<int>> groups;
+    QHash<QString, int> groupOfHeaders;
+    for (int i : valid) {
+        const QString key = _snippets[i].headers.join('\n');
+        if (!groupOfHeaders.contains(key)) {
+            groupOfHeaders.insert(key, groups.count());
+            groups << QList<int>();
+        }
+        groups[groupOfHeaders.value(key)] << i;
+    }
+
+    QStringList binaries;
+    for (int g = 0; g < groups.count(); g++) {
+        const QString aout = aoutName();
+        const int dot = aout.lastIndexOf('.');
+        _binary = aout.left(dot) + QString("-%1").arg(g) + aout.mid(dot);
+        _built.clear();
+        binaries << _binary;
+
+        const QList<int> compiled = bisect(groups[g]);
+        QString error;
+        if (!compiled.isEmpty() && _built != compiled && !build(compiled, &error)) {
+            for (int i : compiled) {
+                _snippets[i].status = "compile_error";
+                _snippets[i].error = error;
+            }
+            continue;
+        }
+        for (int p = 0; p < compiled.count(); p++) {
+            _snippets[compiled[p]].binary = _binary;
+            _snippets[compiled[p]].position = p;
+        }
+    }
+
+    for (int i = 0; i < _snippets.count(); i++) {
+        execute(i);
+    }
+    for (const auto &binary : binaries) {
+        QFile::remove(binary);
+    }
+    return 0;
+}
+
+
+bool BatchEvaluator::build(const QList<int> &indices, QString *error)
+{
+    QStringList codes;
+    QList<bool> safety;
+
+    for (int i : indices) {
+        codes << _snippets[i].code;
+        safety << _snippets[i].safety;
+    }
+
+    // the same headers in the group
+    CodeGenerator cdgen(_snippets[indices.first()].headers.join("\n"), QString());
+    Compiler compiler;
+    bool ok = compiler.build(cdgen.generateBatchFunc(codes, safety), _binary);
+    if (ok) {
+        _built = indices;
+    } else {
+        _built.clear();  // overwritten or removed
+        if (error) {
+            *error = compiler.compilationError();
+        }
+    }
+    return ok;
+}
+
+
+// Splits the snippets until the ones failing to compile are found, and
+// returns the others, which compile together
+QList<int> BatchEvaluator::bisect(const QList<int> &indices)
+{
+    if (build(indices)) {
+        return indices;
+    }
+
+    if (indices.count() == 1) {
+        // compiles once more as statements, same as the interactive mode
+        auto &snippet = _snippets[indices.first()];
+        snippet.safety = true;
+        if (build(indices, &snippet.error)) {
+            return indices;
+        }
+        snippet.safety = false;
+        snippet.status = "compile_error";
+        return QList<int>();
+    }
+
+    int half = indices.count() / 2;
+    return merge(bisect(indices.mid(0, half)), bisect(indices.mid(half)));
+}
+
+
+// Adds the snippets to the ones compiling together; an added one failing
+// to compile with them is found by splitting, and left out with the error
+QList<int> BatchEvaluator::merge(const QList<int> &compiled, const QList<int> &added)
+{
+    if (compiled.isEmpty() || added.isEmpty()) {
+        return compiled + added;
+    }
+
+    QList<int> indices = compiled + added;
+    std::sort(indices.begin(), indices.end());
+    QString error;
+    if (build(indices, &error)) {
+        return indices;
+    }
+
+    if (added.count() == 1) {
+        auto &snippet = _snippets[added.first()];
+        snippet.status = "compile_error";
+        snippet.error = error;
+        return compiled;
+    }
+
+    int half = added.count() / 2;
+    return merge(merge(compiled, added.mid(0, half)), added.mid(half));
+}
+
+
+void BatchEvaluator::execute(int index)
+{
+    const auto &snippet = _snippets[index];
+    QJsonObject result;
+    result.insert("id", snippet.id);
+
+    if (snippet.binary.isEmpty()) {
+        result.insert("status", snippet.status.isEmpty() ? QString("compile_error") : snippet.status);
+        result.insert("error", snippet.error);
+    } else {
+        // each snippet runs in its own process
+        QProcess proc;
+        proc.start(snippet.binary, QStringList(QString::number(snippet.position)));
+        proc.closeWriteChannel();
+
+        QString status;
+        if (!proc.waitForFinished(SnippetTimeout)) {
+            proc.kill();
+            proc.waitForFinished();
+            status = "timeout";
+        } else if (proc.exitStatus() != QProcess::NormalExit || proc.exitCode() != 0) {
+            status = "runtime_error";
+            result.insert("exit_code", (proc.exitStatus() == QProcess::NormalExit) ? proc.exitCode() : -1);
+        } else {
+            status = "ok";
+        }
+
+        result.insert("status", status);
+        result.insert("output", QString::fromLocal8Bit(proc.readAllStandardOutput()));
+        result.insert("error", QString::fromLocal8Bit(proc.readAllStandardError()));
+    }
+
+    print() << QJsonDocument(result).toJson(QJsonDocument::Compact) << endl;
+}
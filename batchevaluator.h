@@ -0,0 +1,33 @@
+#pragma once
+#include <QJsonValue>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+
+// Evaluates many snippets with one compilation, and writes the results in JSON Lines
+class BatchEvaluator {
+public:
+    int run(const QString &path);
+
+private:
+    struct Snippet {
+        QJsonValue id;
+        QString code;
+        QStringList headers;
+        bool safety {false};  // compiled with the safety variant
+        QString status;  // set if it is not executed
+        QString error;
+        QString binary;  // of the group of the same headers, empty if not compiled
+        int position {-1};  // in the binary
+    };
+
+    bool build(const QList<int> &indices, QString *error = nullptr);
+    QList<int> bisect(const QList<int> &indices);
+    QList<int> merge(const QList<int> &compiled, const QList<int> &added);
+    void execute(int index);
+
+    QList<Snippet> _snippets;
+    QString _binary;  // of the group being built
+    QList<int> _built;  // snippets in the binary, in the order of the indices
+};
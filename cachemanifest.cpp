@@ -0,0 +1,223 @@
+#include "cachemanifest.h"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+namespace fs = std::filesystem;
+
+constexpr const char *ManifestHeader = "cpi-binary-cache 2";
+
+
+static std::string hex(uint64_t value)
+{
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)value);
+    return buf;
+}
+
+
+CacheManifest::CacheManifest(const std::string &cacheDir, const std::string &script)
+{
+    std::error_code ec;
+    fs::path path = fs::canonical(script, ec);
+    _script = ec ? fs::absolute(script, ec).string() : path.string();
+    _base = (fs::path(cacheDir) / "bin" / hex(fnv1a(_script.data(), _script.size()))).string();
+}
+
+
+uint64_t CacheManifest::fnv1a(const char *data, size_t size, uint64_t hash)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+// Cache directory of cpi, GenericCacheLocation of Qt + "/cpi"
+std::string CacheManifest::defaultCacheDir()
+{
+#if defined(_WIN32)
+    const char *dir = std::getenv("LOCALAPPDATA");
+    return dir ? std::string(dir) + "\\cache\\cpi" : std::string();
+#elif defined(__APPLE__)
+    const char *home = std::getenv("HOME");
+    return home ? std::string(home) + "/Library/Caches/cpi" : std::string();
+#else
+    const char *xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) {
+        return std::string(xdg) + "/cpi";
+    }
+    const char *home = std::getenv("HOME");
+    return home ? std::string(home) + "/.cache/cpi" : std::string();
+#endif
+}
+
+
+bool CacheManifest::stat(const std::string &path, Entry &entry)
+{
+    std::error_code ec;
+    entry.path = path;
+    entry.size = fs::file_size(path, ec);
+    if (ec) {
+        return false;
+    }
+    entry.mtime = (long long)fs::last_write_time(path, ec).time_since_epoch().count();
+    return !ec;
+}
+
+
+bool CacheManifest::hashFile(const std::string &path, uint64_t &hash)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    char buf[65536];
+    hash = 14695981039346656037ULL;
+    while (file.read(buf, sizeof(buf)) || file.gcount() > 0) {
+        hash = fnv1a(buf, size_t(file.gcount()), hash);
+    }
+    return true;
+}
+
+
+// Identical if the size and the modification time are the same, or
+// if the content is the same (e.g. touched or checked out again)
+bool CacheManifest::isUpToDate(const Entry &entry)
+{
+    Entry current;
+    if (!stat(entry.path, current) || current.size != entry.size) {
+        return false;
+    }
+    if (current.mtime == entry.mtime) {
+        return true;
+    }
+
+    uint64_t hash;
+    return hashFile(entry.path, hash) && hash == entry.hash;
+}
+
+
+// "file <size> <mtime> <hash> <path>" lines, the first one is the script,
+// and "cpi <size> <mtime> <path>" of the executable
+bool CacheManifest::load()
+{
+    std::ifstream file(manifestPath());
+    std::string line;
+    if (!std::getline(file, line) || line != ManifestHeader) {
+        return false;
+    }
+
+    _entries.clear();
+    _cpi = Entry();
+    while (std::getline(file, line)) {
+        std::istringstream ss(line);
+        std::string tag;
+        ss >> tag;
+        if (tag == "key") {
+            ss >> _key;
+        } else if (tag == "direct") {
+            ss >> _direct;
+        } else if (tag == "cpi") {
+            ss >> _cpi.size >> _cpi.mtime;
+            std::getline(ss >> std::ws, _cpi.path);
+        } else if (tag == "file") {
+            Entry entry;
+            std::string hash;
+            ss >> entry.size >> entry.mtime >> hash;
+            std::getline(ss >> std::ws, entry.path);
+            entry.hash = std::strtoull(hash.c_str(), nullptr, 16);
+            _entries.push_back(entry);
+        }
+    }
+    return !_entries.empty() && _entries.front().path == _script;
+}
+
+
+bool CacheManifest::isUpToDate() const
+{
+    if (_entries.empty()) {
+        return false;
+    }
+
+    std::error_code ec;
+    if (!fs::exists(binaryPath(), ec)) {
+        return false;
+    }
+
+    for (const auto &entry : _entries) {
+        if (!isUpToDate(entry)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Built by the cpi executable at the path, not replaced since; the key of
+// the compiler and options is checked by cpi only
+bool CacheManifest::isBuiltBy(const std::string &cpi) const
+{
+    std::error_code ec;
+    const std::string path = fs::canonical(cpi, ec).string();
+    Entry current;
+    return !ec && !_cpi.path.empty() && path == _cpi.path && stat(path, current)
+        && current.size == _cpi.size && current.mtime == _cpi.mtime;
+}
+
+
+// Copies the binary into the cache, then writes the manifest
+bool CacheManifest::store(const std::string &binary, const std::string &key, bool direct, const std::vector<std::string> &dependencies, const std::string &cpi)
+{
+    _key = key;
+    _direct = direct;
+    _entries.clear();
+
+    std::error_code ec;
+    if (!stat(fs::canonical(cpi, ec).string(), _cpi) || ec) {
+        return false;
+    }
+
+    std::vector<std::string> files {_script};
+    files.insert(files.end(), dependencies.begin(), dependencies.end());
+    for (const auto &path : files) {
+        Entry entry;
+        if (!stat(path, entry) || !hashFile(path, entry.hash)) {
+            return false;
+        }
+        _entries.push_back(entry);
+    }
+
+    fs::create_directories(fs::path(_base).parent_path(), ec);
+    const std::string tmp = binaryPath() + ".tmp";
+    fs::copy_file(binary, tmp, fs::copy_options::overwrite_existing, ec);
+    if (ec) {
+        return false;
+    }
+    fs::rename(tmp, binaryPath(), ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+
+    const std::string manifestTmp = manifestPath() + ".tmp";
+    {
+        std::ofstream file(manifestTmp, std::ios::trunc);
+        file << ManifestHeader << "\n";
+        file << "key " << _key << "\n";
+        file << "direct " << _direct << "\n";
+        file << "cpi " << _cpi.size << " " << _cpi.mtime << " " << _cpi.path << "\n";
+        for (const auto &entry : _entries) {
+            file << "file " << entry.size << " " << entry.mtime << " " << hex(entry.hash) << " " << entry.path << "\n";
+        }
+        if (!file) {
+            return false;
+        }
+    }
+    fs::rename(manifestTmp, manifestPath(), ec);
+    return !ec;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Manifest of the binary cached for a script file, read also by the cpi-run
+// launcher; so it depends on the standard library only
+class CacheManifest {
+public:
+    CacheManifest(const std::string &cacheDir, const std::string &script);
+
+    std::string binaryPath() const { return _base + BinarySuffix; }
+    std::string manifestPath() const { return _base + ".manifest"; }
+    const std::string &key() const { return _key; }
+    bool isDirect() const { return _direct; }
+    bool load();
+    bool isUpToDate() const;
+    bool isBuiltBy(const std::string &cpi) const;
+    bool store(const std::string &binary, const std::string &key, bool direct, const std::vector<std::string> &dependencies, const std::string &cpi);
+
+    static uint64_t fnv1a(const char *data, size_t size, uint64_t hash = 14695981039346656037ULL);
+    static std::string defaultCacheDir();
+
+private:
+    struct Entry {
+        std::string path;
+        uintmax_t size {0};
+        long long mtime {0};
+        uint64_t hash {0};
+    };
+
+    static bool stat(const std::string &path, Entry &entry);
+    static bool hashFile(const std::string &path, uint64_t &hash);
+    static bool isUpToDate(const Entry &entry);
+
+#ifdef _WIN32
+    static constexpr const char *BinarySuffix = ".exe";
+#else
+    static constexpr const char *BinarySuffix = ".bin";
+#endif
+
+    std::string _script;  // canonical path
+    std::string _base;  // path of the cache without suffix
+    std::string _key;  // compiler and options, checked by cpi
+    bool _direct {false};  // runnable without cpi (no limits or allocator)
+    std::vector<Entry> _entries;  // the script and the files it depends on
+    Entry _cpi;  // executable which built the binary, checked by cpi-run
+};
@@ -1,18 +1,12 @@
 #include "codegenerator.h"
 #include "compiler.h"
+#include "global.h"
 #include <QtCore/QtCore>
 
-#define CPI_SRC                                                         \
-    "#include <iostream>\n"                                             \
-    "#include <string>\n"                                               \
-    "#include <typeinfo>\n"                                             \
-    "%1\n"                                                              \
-    "%3\n"                                                              \
-    "#define PRINT_IF(type)  if (ti == typeid(type)) { std::cout << (*(type *)p) << std::endl; }\n" \
-    "\n"                                                                \
-    "int main() {\n"                                                    \
-    "%4\n"                                                              \
-    "  %2\n"                                                            \
+// First line number of the template after the user's headers and code
+constexpr int TemplateLine = 100000;
+
+#define CPI_PRINT                                                       \
     "  void *p = (void *)&x_x;\n"                                       \
     "  const std::type_info &ti = typeid(x_x);\n"                       \
     "  if (ti == typeid(char *) || ti == typeid(unsigned char *) || ti == typeid(char const *)) {\n" \
@@ -45,6 +39,43 @@
     "  } else {\n"                                                      \
     "    // disable to print\n"                                         \
     "    std::cout << \"# disable to print : name:\" << ti.name() << \"  size:\" << sizeof(x_x) << std::endl;\n" \
+    "  }\n"
+
+#define CPI_SRC                                                         \
+    "%6\n"                                                              \
+    "%1\n"                                                              \
+    "%3\n"                                                              \
+    "#define PRINT_IF(type)  if (ti == typeid(type)) { std::cout << (*(type *)p) << std::endl; }\n" \
+    "\n"                                                                \
+    "int main() {\n"                                                    \
+    "%4\n"                                                              \
+    "  %2\n"                                                            \
+    CPI_PRINT                                                           \
+    "  return 0;\n"                                                     \
+    "}"
+
+// Snippets as functions, and main dispatching the one of the index
+#define CPI_BATCH_SRC                                                   \
+    "%6\n"                                                              \
+    "%1\n"                                                              \
+    "%3\n"                                                              \
+    "#define PRINT_IF(type)  if (ti == typeid(type)) { std::cout << (*(type *)p) << std::endl; }\n" \
+    "\n"                                                                \
+    "template <typename T>\n"                                           \
+    "static void cpi_print(const T &x_x) {\n"                           \
+    CPI_PRINT                                                           \
+    "}\n"                                                               \
+    "\n"                                                                \
+    "%2\n"                                                              \
+    "int main(int argc, char *argv[]) {\n"                              \
+    "%4\n"                                                              \
+    "  int index = -1;\n"                                               \
+    "  for (const char *c = (argc > 1) ? argv[1] : \"\"; *c; ++c)\n"    \
+    "    index = (index < 0 ? 0 : index * 10) + (*c - '0');\n"          \
+    "  switch (index) {\n"                                              \
+    "%7"                                                                \
+    "  default:\n"                                                      \
+    "    return 2;\n"                                                   \
     "  }\n"                                                             \
     "  return 0;\n"                                                     \
     "}"
@@ -126,11 +157,53 @@ QString CodeGenerator::generateMainFunc(bool safety) const
         return src;
     }
 
-    QString modified = modifyCode(_code, safety);
+    // numbers the lines as shown by .show in diagnostics, and the lines of
+    // the template out of them
+    const int headerLines = _headers.isEmpty() ? 0 : _headers.count('\n') + 1;
+    QString headers = "#line 1\n" + _headers + QString("\n#line %1").arg(TemplateLine);
+    QString modified = QString("\n#line %1\n").arg(headerLines + 1) + modifyCode(_code, safety) + QString("\n#line %1").arg(TemplateLine);
+    QString prelude = useStdModule() ? QString("import std;") : preludeIncludes().join("\n");
     if (Compiler::isSetQtOption()) {
-        src = QString(CPI_SRC).arg(_headers, modified, QT_HEADERS, QT_INIT, QT_PARSE);
+        src = QString(CPI_SRC).arg(headers, modified, QT_HEADERS, QT_INIT, QT_PARSE, prelude);
     } else {
-        src = QString(CPI_SRC).arg(_headers, modified, "", "", "");
+        src = QString(CPI_SRC).arg(headers, modified, "", "", "", prelude);
     }
     return src;
 }
+
+
+// Generates each snippet as a function, called by the index given as the
+// first argument of the program
+QString CodeGenerator::generateBatchFunc(const QStringList &snippets, const QList<bool> &safety) const
+{
+    QString funcs;
+    QString cases;
+
+    for (int i = 0; i < snippets.count(); i++) {
+        funcs += QString("static void cpi_snippet_%1() {\n  %2  cpi_print(x_x);\n}\n\n").arg(i).arg(modifyCode(snippets[i], safety.value(i)));
+        cases += QString("  case %1:\n    cpi_snippet_%1();\n    break;\n").arg(i);
+    }
+
+    QString prelude = useStdModule() ? QString("import std;") : preludeIncludes().join("\n");
+    if (Compiler::isSetQtOption()) {
+        return QString(CPI_BATCH_SRC).arg(_headers, funcs, QT_HEADERS, QT_INIT, QT_PARSE, prelude, cases);
+    }
+    return QString(CPI_BATCH_SRC).arg(_headers, funcs, "", "", "", prelude, cases);
+}
+
+
+// Headers included by the generated code
+QStringList CodeGenerator::preludeIncludes()
+{
+    if (useStdModule()) {
+        return QStringList();
+    }
+    return QStringList {"#include <iostream>", "#include <string>", "#include <typeinfo>"};
+}
+
+
+// Imports the std module instead of including the headers
+bool CodeGenerator::useStdModule()
+{
+    return conf->value("USE_STD_MODULE", false).toBool();
+}
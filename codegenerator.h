@@ -1,11 +1,16 @@
 #pragma once
 #include <QString>
 #include <QByteArray>
+#include <QList>
+#include <QStringList>
 
 class CodeGenerator {
 public:
     CodeGenerator(const QString &headers, const QString &code);
     QString generateMainFunc(bool safety = false) const;
+    QString generateBatchFunc(const QStringList &snippets, const QList<bool> &safety) const;
+    static QStringList preludeIncludes();
+    static bool useStdModule();
     //QString generateMainFuncSafe() const;
 
 private:
@@ -1,18 +1,34 @@
 #include "compiler.h"
+#include "cachemanifest.h"
+#include "externtemplates.h"
 #include "global.h"
 #include "print.h"
+#include "stableenvironment.h"
+#include "tracer.h"
 #include <QtCore/QtCore>
+#include <QCryptographicHash>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <vector>
 #ifdef Q_OS_WIN
 #include <QWinEventNotifier>
 #include <windows.h>
 #include "ptyprocess_win.h"
 #else
 #include "ptyprocess.h"
+#include "allocator.h"
+#include "heapprofiler.h"
+#include "profiler.h"
+#include "resourcegovernor.h"
 #endif
 using namespace cpi;
 
+constexpr qint64 MaxPendingInput = 1024 * 1024;  // bytes queued for the program's stdin
+
 
 const QList<QPair<QString, QStringList>> requiredOptions = {
     {"gcc", {"-xc"}},
@@ -46,6 +62,7 @@ static QString searchPath(const QString &command)
 
 QString Compiler::cxx()
 {
+    TraceSpan span("Compiler::cxx");
     QString compiler = conf->value("CXX").toString().trimmed();
 
     if (compiler.isEmpty()) {
@@ -105,8 +122,22 @@ Compiler::~Compiler()
 }
 
 
+// Msecs of the monotonic clock, comparable between instances
+qint64 Compiler::steadyClock()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+QString Compiler::sourceFilePath()
+{
+    return QDir::tempPath() + QDir::separator() + "cpisource" + QString::number(QCoreApplication::applicationPid()) + ".cpp";
+}
+
+
 bool Compiler::compile(const QString &cc, const QStringList &options, const QString &code)
 {
+    TraceSpan span("Compiler::compile");
     _compileError.clear();
     _sourceCode = code.trimmed();
     auto ccOptions = options;
@@ -122,6 +153,21 @@ bool Compiler::compile(const QString &cc, const QStringList &options, const QStr
     ccOptions << temp.fileName();
 #endif
 
+#ifndef Q_CC_MSVC
+    QFile temp(sourceFilePath());
+    if (_sourceFile) {
+        // source file instead of standard input
+        if (temp.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+            temp.write(_sourceCode.toLocal8Bit());
+            temp.close();
+        }
+        int idx = ccOptions.indexOf("-");
+        if (idx >= 0) {
+            ccOptions[idx] = temp.fileName();
+        }
+    }
+#endif
+
     if (isSetDebugOption()) {
         QFile file("dummy.cpp");
         if (file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
@@ -130,34 +176,64 @@ bool Compiler::compile(const QString &cc, const QStringList &options, const QStr
         }
     }
 
+#ifndef Q_CC_MSVC
+    // compiler's own trace
+    QString timeTrace;
+    if (Tracer::globalInstance().isEnabled() && isClang(cc)) {
+        timeTrace = QDir::tempPath() + QDir::separator() + ".cpitrace" + QString::number(QCoreApplication::applicationPid()) + ".json";
+        ccOptions << "-ftime-trace=" + timeTrace;
+    }
+#endif
+
     // qDebug() << cc << ccOptions;
     // qDebug() << code;
     QProcess compileProc;
+    const qint64 begin = Tracer::globalInstance().now();
     compileProc.start(cc, ccOptions);
+    const qint64 ccpid = compileProc.processId();
 
 #ifdef Q_CC_MSVC
-    compileProc.waitForFinished();
+    bool finished = waitForCompiler(compileProc);
     _compileError = QString::fromLocal8Bit(compileProc.readAllStandardOutput());
     objtemp.remove();
     temp.remove();
 #else
-    compileProc.write(_sourceCode.toLocal8Bit());
-    compileProc.waitForBytesWritten();
+    if (!_sourceFile) {
+        compileProc.write(_sourceCode.toLocal8Bit());
+        compileProc.waitForBytesWritten();
+    }
     compileProc.closeWriteChannel();
-    compileProc.waitForFinished();
+    bool finished = waitForCompiler(compileProc);
     _compileError = QString::fromLocal8Bit(compileProc.readAllStandardError());
+    if (_sourceFile) {
+        temp.remove();
+    }
+#endif
+
+    if (!finished) {
+        _compileError = _interruption;
+        return false;
+    }
+
+    if (Tracer::globalInstance().isEnabled()) {
+        auto &tracer = Tracer::globalInstance();
+        tracer.setProcessName(ccpid, QFileInfo(cc).fileName());
+        tracer.addSpan(QFileInfo(cc).fileName(), begin, tracer.now() - begin, ccpid, "compiler");
+#ifndef Q_CC_MSVC
+        if (!timeTrace.isEmpty()) {
+            tracer.addClangTimeTrace(timeTrace, ccpid, begin);
+            QFile::remove(timeTrace);
+        }
 #endif
+    }
 
     // qDebug() << "#" << _compileError << "#";
     return (compileProc.exitStatus() == QProcess::NormalExit && compileProc.exitCode() == 0);
 }
 
 
-int Compiler::compileAndExecute(const QString &cc, const QStringList &options, const QString &src)
+static void splitOptions(const QStringList &options, QStringList &ccOpts, QStringList &linkOpts)
 {
-    QStringList ccOpts;
-    QStringList linkOpts;
-
     for (auto &op : options) {
 #ifndef Q_CC_MSVC
         if (op.startsWith("-L", Qt::CaseInsensitive) || op.startsWith("-Wl,")) {
@@ -170,88 +246,1161 @@ int Compiler::compileAndExecute(const QString &cc, const QStringList &options, c
             continue;
         }
     }
+}
+
 
-    QStringList ccopt;
+static QStringList languageOptions(const QString &cc)
+{
     QString fname = QFileInfo(cc).fileName();
     for (const auto &it : requiredOptions) {
         if (fname.startsWith(it.first)) {
-            ccOpts << it.second;
-            break;
+            return it.second;
         }
     }
+    return QStringList();
+}
+
+
+// Headers bundled with cpi (cpi/fastio.h), copied into the cache directory
+// to be on the include path of every compilation
+static QString runtimeIncludePath()
+{
+    static QString path = []() {
+        QDir dir(cacheDirPath() + "/include");
+        QDirIterator it(":/runtime", QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            QFile src(it.next());
+            const QString dst = dir.filePath(it.filePath().mid(QString(":/runtime/").length()));
+            QFile file(dst);
+            if (!src.open(QIODevice::ReadOnly)) {
+                continue;
+            }
+            const QByteArray content = src.readAll();
+            if (file.open(QIODevice::ReadOnly) && file.readAll() == content) {
+                continue;  // up to date
+            }
+            file.close();
+
+            // written aside and renamed, not to be read half written by
+            // another cpi compiling at the same time
+            QDir().mkpath(QFileInfo(dst).absolutePath());
+            QFile tmp(dst + QString(".%1.tmp").arg(QCoreApplication::applicationPid()));
+            if (tmp.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                bool ok = (tmp.write(content) == content.size());
+                tmp.close();
+                if (!ok || !replaceFile(tmp.fileName(), dst)) {
+                    tmp.remove();
+                }
+            }
+        }
+        return dir.absolutePath();
+    }();
+    return path;
+}
+
 
+static QStringList runtimeOptions()
+{
 #ifdef Q_CC_MSVC
-    ccOpts << "-Fe:" + aoutName();
+    return QStringList {"-I" + QDir::toNativeSeparators(runtimeIncludePath())};
+#else
+    return QStringList {"-isystem", runtimeIncludePath()};
+#endif
+}
+
+
+// Whether to stop the compiler or the program; interrupted by Ctrl-C,
+// canceled, or timed out after the seconds of timeout (0 for no limit)
+bool Compiler::interrupted(qint64 elapsed, int timeout, const QString &what)
+{
+    if (_interruption.isEmpty()) {
+        if (gInterruptRequested) {
+            _interruption = "Interrupted";
+        } else if (timeout > 0 && elapsed >= timeout * 1000LL) {
+            _interruption = QString("The %1 timed out after %2 s").arg(what).arg(timeout);
+        }
+    }
+    return _canceled || !_interruption.isEmpty();
+}
+
+
+// Waits for the compiler, and kills it when interrupted
+bool Compiler::waitForCompiler(QProcess &proc)
+{
+    const int timeout = conf->value("COMPILE_TIMEOUT", 0).toInt();
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!proc.waitForFinished(50)) {
+        if (proc.state() == QProcess::NotRunning) {
+            break;  // failed to start
+        }
+
+        if (interrupted(timer.elapsed(), timeout, "compilation")) {
+            proc.kill();
+            proc.waitForFinished(-1);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Waits until one of the processes finishes, or up to msecs
+static void waitForAnyFinished(const QList<QProcess *> &procs, int msecs)
+{
+    QEventLoop loop;
+    for (auto *proc : procs) {
+        if (proc->state() == QProcess::NotRunning) {
+            return;  // finished, or failed to start
+        }
+        QObject::connect(proc, qOverload<int, QProcess::ExitStatus>(&QProcess::finished), &loop, &QEventLoop::quit);
+        QObject::connect(proc, &QProcess::errorOccurred, &loop, &QEventLoop::quit);
+    }
+    QTimer::singleShot(msecs, &loop, &QEventLoop::quit);
+    loop.exec();
+}
+
+
+QStringList Compiler::compileFlags(const QString &cc, const QStringList &options)
+{
+    QStringList ccOpts;
+    QStringList linkOpts;
+    splitOptions(options, ccOpts, linkOpts);
+    ccOpts << languageOptions(cc);
+    ccOpts << runtimeOptions();
+    return ccOpts;
+}
+
+
+bool Compiler::isClang(const QString &cc)
+{
+    static QHash<QString, bool> clangs;
+
+    if (!clangs.contains(cc)) {
+        bool clang = QFileInfo(cc).fileName().contains("clang");
+        if (!clang && !QFileInfo(cc).fileName().startsWith("cl")) {
+            // c++ command may be clang
+            QProcess proc;
+            proc.start(cc, {"--version"});
+            proc.waitForFinished();
+            clang = proc.readAllStandardOutput().contains("clang");
+        }
+        clangs.insert(cc, clang);
+    }
+    return clangs.value(cc);
+}
+
+
+QStringList Compiler::precompiledHeaderOptions(const QString &cc, const QStringList &ccOpts)
+{
+#ifdef Q_CC_MSVC
+    Q_UNUSED(cc);
+    Q_UNUSED(ccOpts);
+    return QStringList();
+#else
+    const QStringList includes = conf->value("PRECOMPILED_HEADERS").toString().split(" ", SkipEmptyParts);
+    if (!ccOpts.contains("-xc++")) {
+        return QStringList();
+    }
+
+    // declarations of the templates instantiated in the library
+    const QString externs = ExternTemplates::library(cc, ccOpts).isEmpty() ? QString() : ExternTemplates::declarations();
+    if (includes.isEmpty() && externs.isEmpty()) {
+        return QStringList();
+    }
+
+    QString prelude;
+    for (const auto &inc : includes) {
+        if (inc.startsWith("<") || inc.startsWith('"')) {
+            prelude += QString("#include ") + inc + "\n";
+        } else {
+            prelude += QString("#include <") + inc + ">\n";
+        }
+    }
+    prelude += externs;
+
+    // One PCH for each compiler, flags and headers
+    QByteArray key = (cc + "\n" + ccOpts.join("\n") + "\n" + prelude).toUtf8();
+    QString dir = cacheDirPath() + "/pch/" + QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex().left(16);
+    QString header = dir + "/prelude.h";
+    QString pch = header + (isClang(cc) ? ".pch" : ".gch");
+
+    if (!QFileInfo(pch).exists()) {
+        QDir(dir).mkpath(".");
+        QFile file(header);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return QStringList();
+        }
+        file.write(prelude.toUtf8());
+        file.close();
+
+        QStringList opts = ccOpts;
+        opts.replaceInStrings(QRegularExpression("^-xc\\+\\+$"), "-xc++-header");
+        opts << header << "-o" << pch;
+
+        QProcess proc;
+        proc.start(cc, opts);
+        proc.waitForFinished(-1);
+        if (proc.exitStatus() != QProcess::NormalExit || proc.exitCode() != 0) {
+            print() << "Failed to build the precompiled headers: " << includes.join(" ") << endl;
+            print() << QString::fromLocal8Bit(proc.readAllStandardError()) << flush;
+            QFile::remove(pch);
+            return QStringList();
+        }
+    }
+
+    if (isClang(cc)) {
+        return QStringList {"-include-pch", pch};
+    }
+    return QStringList {"-include", header};  // g++ picks up the .gch next to it
+#endif
+}
+
+
+bool Compiler::usesStdModule(const QString &src)
+{
+    static const QRegularExpression re("^\\s*import\\s+std(\\.compat)?\\s*;", QRegularExpression::MultilineOption);
+    return re.match(src).hasMatch();
+}
+
+
+// Builds the std and std.compat modules once for each compiler and flags,
+// and returns the options and objects to use them
+bool Compiler::stdModuleOptions(const QString &cc, const QStringList &ccOpts, QStringList &moduleOpts, QStringList &objects)
+{
+    QByteArray key = (cc + "\n" + ccOpts.join("\n")).toUtf8();
+    QDir dir(cacheDirPath() + "/modules/" + QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex().left(16));
+    QStringList buildOpts = ccOpts;
+    buildOpts.removeAll("-xc++");
+
+    auto run = [&](const QStringList &args) {
+        QProcess proc;
+        proc.setWorkingDirectory(dir.absolutePath());
+        proc.start(cc, args);
+        proc.waitForFinished(-1);
+        if (proc.exitStatus() != QProcess::NormalExit || proc.exitCode() != 0) {
+            _compileError = QString::fromLocal8Bit(proc.readAllStandardError() + proc.readAllStandardOutput());
+            return false;
+        }
+        return true;
+    };
+
+#ifdef Q_CC_MSVC
+    const QString ifc = dir.filePath("std.ifc");
+    const QString compatIfc = dir.filePath("std.compat.ifc");
+    if (!QFileInfo(compatIfc).exists()) {
+        QString modules = qEnvironmentVariable("VCToolsInstallDir") + "modules";
+        if (!QFileInfo(modules + "/std.ixx").exists()) {
+            _compileError = "std module source not found: " + modules + "/std.ixx\n";
+            return false;
+        }
+
+        print() << "Building the std module ..." << endl;
+        dir.mkpath(".");
+        if (!run(QStringList(buildOpts) << "-c" << modules + "/std.ixx" << modules + "/std.compat.ixx")) {
+            return false;
+        }
+    }
+    moduleOpts << "-reference" << "std=" + ifc << "-reference" << "std.compat=" + compatIfc;
+    objects << dir.filePath("std.obj") << dir.filePath("std.compat.obj");
+#else
+    if (isClang(cc)) {
+        const QString pcm = dir.filePath("std.pcm");
+        const QString compatPcm = dir.filePath("std.compat.pcm");
+        if (!QFileInfo(dir.filePath("std.compat.o")).exists()) {
+            // libc++ ships the module sources
+            QProcess proc;
+            proc.start(cc, QStringList(buildOpts) << "-print-file-name=libc++.modules.json");
+            proc.waitForFinished();
+            QString json = QString::fromLocal8Bit(proc.readAllStandardOutput()).trimmed();
+            QFile jsonFile(json);
+            if (!jsonFile.open(QIODevice::ReadOnly)) {
+                _compileError = "std module source not found; libc++ (-stdlib=libc++) is required\n";
+                return false;
+            }
+
+            QString stdSrc, compatSrc;
+            const QJsonArray array = QJsonDocument::fromJson(jsonFile.readAll()).object().value("modules").toArray();
+            for (const auto &v : array) {
+                QString name = v.toObject().value("logical-name").toString();
+                QString path = QFileInfo(json).absoluteDir().filePath(v.toObject().value("source-path").toString());
+                if (name == "std") {
+                    stdSrc = path;
+                } else if (name == "std.compat") {
+                    compatSrc = path;
+                }
+            }
+
+            print() << "Building the std module ..." << endl;
+            dir.mkpath(".");
+            QStringList pcmOpts = QStringList(buildOpts) << "-Wno-reserved-module-identifier" << "--precompile";
+            if (!run(QStringList(pcmOpts) << stdSrc << "-o" << pcm)
+                || !run(QStringList(pcmOpts) << "-fmodule-file=std=" + pcm << compatSrc << "-o" << compatPcm)
+                || !run(QStringList(buildOpts) << "-c" << pcm << "-o" << dir.filePath("std.o"))
+                || !run(QStringList(buildOpts) << "-fmodule-file=std=" + pcm << "-c" << compatPcm << "-o" << dir.filePath("std.compat.o"))) {
+                return false;
+            }
+        }
+        moduleOpts << "-fmodule-file=std=" + pcm << "-fmodule-file=std.compat=" + compatPcm;
+    } else {
+        // g++ 15 or later
+        if (!QFileInfo(dir.filePath("std.compat.o")).exists()) {
+            print() << "Building the std module ..." << endl;
+            dir.mkpath(".");
+            if (!run(QStringList(buildOpts) << "-fmodules" << "-fsearch-include-path" << "-c" << "bits/std.cc" << "bits/std.compat.cc")) {
+                return false;
+            }
+
+            QFile mapper(dir.filePath("module.map"));
+            if (!mapper.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                return false;
+            }
+            mapper.write(QString("std %1\nstd.compat %2\n").arg(dir.filePath("gcm.cache/std.gcm"), dir.filePath("gcm.cache/std.compat.gcm")).toUtf8());
+        }
+        moduleOpts << "-fmodules" << "-fmodule-mapper=" + dir.filePath("module.map");
+    }
+    objects << dir.filePath("std.o") << dir.filePath("std.compat.o");
+#endif
+    return true;
+}
+
+
+// Options to compile the source into the output binary
+bool Compiler::buildOptions(const QString &cc, const QStringList &options, const QString &src, const QString &output, QStringList &ccOpts)
+{
+    QStringList linkOpts;
+    splitOptions(options, ccOpts, linkOpts);
+    ccOpts << languageOptions(cc);
+    ccOpts << runtimeOptions();
+
+    QStringList objects;
+    _sourceFile = usesStdModule(src);
+    if (_sourceFile) {
+        // modules can not be built from stdin
+        QStringList moduleOpts;
+        if (!stdModuleOptions(cc, ccOpts, moduleOpts, objects)) {
+            return false;
+        }
+        ccOpts << moduleOpts;
+    } else {
+        const QString instantiations = ExternTemplates::library(cc, ccOpts);
+        if (!instantiations.isEmpty()) {
+            objects << instantiations;
+        }
+        ccOpts << precompiledHeaderOptions(cc, ccOpts);
+    }
+
+    for (const auto &obj : _objects) {
+        if (!objects.contains(obj)) {
+            objects << obj;
+        }
+    }
+
+    if (_trackDependencies) {
+#ifdef Q_CC_MSVC
+        ccOpts << "-sourceDependencies" << output + ".json";
+#else
+        ccOpts << "-MMD" << "-MF" << output + ".d";
+#endif
+    }
+
+#ifdef Q_CC_MSVC
+    ccOpts << "-Fe:" + output;
+    ccOpts << objects;
 #else
     ccOpts << "-o";
-    ccOpts << aoutName();
+    ccOpts << output;
     ccOpts << "-";  // standard input
+    if (!objects.isEmpty()) {
+        ccOpts << "-xnone" << objects;
+    }
 #endif
     ccOpts << linkOpts;
+    return true;
+}
 
-    bool cpl = compile(cc, ccOpts, src);
-    if (cpl) {
-        // Executes the binary
-        PtyProcess exe;
-        exe.start(aoutName(), cppsArgs);
 
-#ifdef Q_OS_WIN
-        setTerminalMode(false);
-        HANDLE stdinHandle = GetStdHandle(STD_INPUT_HANDLE);
-        QWinEventNotifier notifier(stdinHandle);
-        QObject::connect(&notifier, &QWinEventNotifier::activated, [&]() {
-            notifier.setEnabled(false);
-            auto input = readStdInput();
-            if (!input.isEmpty()) {
-                exe.write(input);
+// Files the object depends on, from the dependency file
+static QStringList dependencyFiles(const QString &depfile)
+{
+    QFile file(depfile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QStringList();
+    }
+
+    QStringList deps;
+#ifdef Q_CC_MSVC
+    // JSON of /sourceDependencies
+    QJsonObject data = QJsonDocument::fromJson(file.readAll()).object().value("Data").toObject();
+    deps << data.value("Source").toString();
+    for (const auto &v : data.value("Includes").toArray()) {
+        deps << v.toString();
+    }
+#else
+    // Makefile rule of -MMD
+    QString rule = QString::fromLocal8Bit(file.readAll()).replace("\\\n", " ");
+    rule = rule.mid(rule.indexOf(": ") + 2);
+
+    QString dep;
+    for (int i = 0; i < rule.length(); i++) {
+        if (rule[i] == '\\' && i + 1 < rule.length() && rule[i + 1] == ' ') {
+            dep += rule[++i];  // escaped space
+        } else if (rule[i].isSpace()) {
+            if (!dep.isEmpty()) {
+                deps << dep;
+                dep.clear();
             }
-            notifier.setEnabled(true);
-        });
+        } else {
+            dep += rule[i];
+        }
+    }
+    if (!dep.isEmpty()) {
+        deps << dep;
+    }
+#endif
+    deps.removeAll(QString());
+    return deps;
+}
+
+
+// Compiles the translation units of the Sources directive in parallel.
+// Each object is cached by the hash of the compiler, flags and content of
+// the source, and rebuilt when a header it includes is modified.
+bool Compiler::compileSources(const QString &cc, const QStringList &options, QStringList &objects)
+{
+    TraceSpan span("Compiler::sources");
+    QStringList ccOpts;
+    QStringList linkOpts;
+    splitOptions(options, ccOpts, linkOpts);
+    ccOpts << languageOptions(cc);
+    ccOpts << runtimeOptions();
+
+    QDir dir(cacheDirPath() + "/objs");
+    dir.mkpath(".");
+
+#ifdef Q_CC_MSVC
+    const QString objSuffix = ".obj";
+    const QString depSuffix = ".json";
+#else
+    const QString objSuffix = ".o";
+    const QString depSuffix = ".d";
+#endif
+
+    // written to temporary files of this process and renamed, not to be
+    // taken half-written by another cpi building the same object
+    const QString tmpSuffix = QString(".%1.tmp").arg(QCoreApplication::applicationPid());
+
+    struct Job {
+        QString source;
+        QString object;
+        QStringList options;
+        std::unique_ptr<QProcess> proc;
+        qint64 begin {0};
+        bool done {false};
+    };
+
+    std::vector<Job> jobs;
+    QStringList sourceObjects;
+    for (const auto &source : _sources) {
+        QFile file(source);
+        if (!file.open(QIODevice::ReadOnly)) {
+            _compileError = "File open error, " + source + "\n";
+            return false;
+        }
+        const QByteArray content = file.readAll();
+
+        QStringList opts = ccOpts;
+        if (usesStdModule(QString::fromLocal8Bit(content))) {
+            QStringList moduleOpts;
+            if (!stdModuleOptions(cc, ccOpts, moduleOpts, objects)) {
+                return false;
+            }
+            opts << moduleOpts;
+        } else {
+            opts << precompiledHeaderOptions(cc, ccOpts);
+        }
+
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData((cc + "\n" + opts.join("\n") + "\n" + source + "\n").toUtf8());
+        hash.addData(content);
+        QString object = dir.filePath(hash.result().toHex().left(16) + objSuffix);
+        objects << object;
+        sourceObjects << object;
+
+        // up to date?
+        QFileInfo objInfo(object);
+        if (objInfo.exists()) {
+            const QStringList deps = dependencyFiles(object + depSuffix);
+            bool updated = deps.isEmpty();
+            for (const auto &dep : deps) {
+                QFileInfo depInfo(dep);
+                if (!depInfo.exists() || depInfo.lastModified() > objInfo.lastModified()) {
+                    updated = true;
+                    break;
+                }
+            }
+            if (!updated) {
+                continue;
+            }
+        }
+        jobs.push_back(Job {source, object, opts});
+    }
+    objects.removeDuplicates();
+
+    auto &tracer = Tracer::globalInstance();
+    const int maxJobs = std::max(QThread::idealThreadCount(), 1);
+    size_t next = 0;
+    int running = 0;
+    bool ok = true;
+    const int timeout = conf->value("COMPILE_TIMEOUT", 0).toInt();
+    QElapsedTimer timer;
+    timer.start();
+
+    while ((ok && next < jobs.size()) || running > 0) {
+        if (interrupted(timer.elapsed(), timeout, "compilation")) {
+            for (auto &job : jobs) {
+                if (job.proc && !job.done) {
+                    job.proc->kill();
+                    job.proc->waitForFinished(-1);
+                    QFile::remove(job.object + tmpSuffix);
+                    QFile::remove(job.object + depSuffix + tmpSuffix);
+                }
+            }
+            _compileError = _interruption;
+            return false;
+        }
+
+        while (ok && next < jobs.size() && running < maxJobs) {
+            auto &job = jobs[next++];
+            QStringList args = job.options;
+#ifdef Q_CC_MSVC
+            args << "-sourceDependencies" << job.object + depSuffix + tmpSuffix << "-c" << "-Fo" + job.object + tmpSuffix << job.source;
 #else
-        setTerminalMode(false);
-        QSocketNotifier notifier(STDIN_FILENO, QSocketNotifier::Read);
-        QObject::connect(&notifier, &QSocketNotifier::activated, [&]() {
-            notifier.setEnabled(false);
-            auto input = readStdInput();
-            if (!input.isEmpty()) {
-                exe.write(input);
+            args << "-MMD" << "-MF" << job.object + depSuffix + tmpSuffix << "-c" << job.source << "-o" << job.object + tmpSuffix;
+#endif
+            job.proc = std::make_unique<QProcess>();
+            job.begin = tracer.now();
+            job.proc->start(cc, args);
+            running++;
+        }
+
+        // interruptions are checked every 50 ms
+        QList<QProcess *> procs;
+        for (const auto &job : jobs) {
+            if (job.proc && !job.done) {
+                procs << job.proc.get();
             }
-            notifier.setEnabled(true);
-        });
+        }
+        waitForAnyFinished(procs, 50);
+
+        for (auto &job : jobs) {
+            if (!job.proc || job.done || job.proc->state() != QProcess::NotRunning) {
+                continue;
+            }
+
+            job.done = true;
+            running--;
+            if (tracer.isEnabled()) {
+                tracer.addSpan(QFileInfo(job.source).fileName(), job.begin, tracer.now() - job.begin, 0, "compiler");
+            }
+
+            if (job.proc->error() != QProcess::FailedToStart && job.proc->exitStatus() == QProcess::NormalExit && job.proc->exitCode() == 0) {
+                // the dependencies first, which are checked when the object exists
+                replaceFile(job.object + depSuffix + tmpSuffix, job.object + depSuffix);
+                replaceFile(job.object + tmpSuffix, job.object);
+            } else {
+                ok = false;
+#ifdef Q_CC_MSVC
+                _compileError += QString::fromLocal8Bit(job.proc->readAllStandardOutput());
+#else
+                _compileError += QString::fromLocal8Bit(job.proc->readAllStandardError());
 #endif
+                QFile::remove(job.object + tmpSuffix);
+                QFile::remove(job.object + depSuffix + tmpSuffix);
+            }
+        }
+    }
+
+    if (_trackDependencies) {
+        _dependencies << _sources;
+        for (const auto &object : sourceObjects) {
+            _dependencies << dependencyFiles(object + depSuffix);
+        }
+    }
+    return ok;
+}
+
 
-        while (!exe.waitForFinished(50)) {
-            auto exeout = exe.readAll();
-            if (!exeout.isEmpty()) {
-                // stdout raw data
-                std::cout.write(exeout.constData(), exeout.size());
-                std::cout.flush();
+// Compilers of CXX_RACE found in the path
+QStringList Compiler::raceCompilers()
+{
+    QStringList compilers;
+#ifndef Q_CC_MSVC
+    for (const auto &name : conf->value("CXX_RACE").toStringList()) {
+        QString path = searchPath(name.trimmed());
+        if (!path.isEmpty() && !compilers.contains(path)) {
+            compilers << path;
+        }
+    }
+#endif
+    return (compilers.count() >= 2) ? compilers : QStringList();
+}
+
+
+// Runs the compilers in parallel and takes the first successful binary.
+// Compilation errors are reported from the first (preferred) compiler.
+bool Compiler::race(const QStringList &compilers, const QStringList &options, const QString &src)
+{
+    TraceSpan span("Compiler::race");
+    _compileError.clear();
+    _sourceCode = src.trimmed();
+
+    struct Racer {
+        QString cc;
+        QString output;
+        std::unique_ptr<QProcess> proc;
+        bool done {false};
+        qint64 msecs {-1};  // until finished or killed
+    };
+
+    std::vector<Racer> racers;
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < compilers.count(); i++) {
+        Racer racer {compilers[i], aoutName() + "." + QString::number(i), std::make_unique<QProcess>()};
+        QStringList ccOpts;
+        if (!buildOptions(racer.cc, options, src, racer.output, ccOpts)) {
+            if (i == 0) {
+                return false;
             }
+            continue;
+        }
 
-            if (exe.state() != QProcess::Running) {
-                break;
+        if (_sourceFile) {
+            // source file instead of standard input
+            QFile temp(sourceFilePath());
+            if (temp.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                temp.write(_sourceCode.toLocal8Bit());
+                temp.close();
             }
+            ccOpts[ccOpts.indexOf("-")] = temp.fileName();
+        }
 
-#ifdef Q_OS_WIN
-            if (gQuitRequested) {
-                exe.kill();
+        racer.proc->start(racer.cc, ccOpts);
+        if (!_sourceFile) {
+            racer.proc->write(_sourceCode.toLocal8Bit());
+        }
+        racer.proc->closeWriteChannel();
+        racers.push_back(std::move(racer));
+    }
+
+    int winner = -1;
+    int running = racers.size();
+    const int timeout = conf->value("COMPILE_TIMEOUT", 0).toInt();
+    while (running > 0 && winner < 0) {
+        if (interrupted(timer.elapsed(), timeout, "compilation")) {
+            _compileError = _interruption;
+            break;
+        }
+
+        // interruptions are checked every 50 ms
+        QList<QProcess *> procs;
+        for (const auto &racer : racers) {
+            if (!racer.done) {
+                procs << racer.proc.get();
+            }
+        }
+        waitForAnyFinished(procs, 50);
+
+        for (size_t i = 0; i < racers.size(); i++) {
+            auto &racer = racers[i];
+            if (racer.done || racer.proc->state() != QProcess::NotRunning) {
+                continue;
+            }
+
+            racer.done = true;
+            racer.msecs = timer.elapsed();
+            running--;
+            if (racer.proc->error() != QProcess::FailedToStart && racer.proc->exitStatus() == QProcess::NormalExit && racer.proc->exitCode() == 0) {
+                winner = i;
                 break;
             }
+
+            if (racer.cc == compilers.first()) {
+                _compileError = QString::fromLocal8Bit(racer.proc->readAllStandardError());
+            }
+        }
+    }
+    const qint64 elapsed = timer.elapsed();
+
+    for (auto &racer : racers) {
+        if (!racer.done) {
+            racer.msecs = elapsed;
+            racer.proc->kill();
+            racer.proc->waitForFinished();
+        }
+    }
+
+    if (winner >= 0) {
+        QFile::remove(aoutName());
+        QFile::rename(racers[winner].output, aoutName());
+        if (_trackDependencies) {
+            _dependencies << dependencyFiles(racers[winner].output + ".d");
+        }
+    }
+
+    for (auto &racer : racers) {
+        QFile::remove(racer.output);
+        QFile::remove(racer.output + ".d");
+    }
+    if (_sourceFile) {
+        QFile::remove(sourceFilePath());
+    }
+
+    // tally of every compiler; a loser killed is counted by the time it ran
+    QSettings tally(cacheDirPath() + "/race.ini", QSettings::IniFormat);
+    tally.setValue("races", tally.value("races", 0).toInt() + 1);
+    for (int i = 0; i < int(racers.size()); i++) {
+        const QString key = QFileInfo(racers[i].cc).fileName();
+        tally.setValue(key + "/runs", tally.value(key + "/runs", 0).toInt() + 1);
+        tally.setValue(key + "/latency", tally.value(key + "/latency", 0).toLongLong() + racers[i].msecs);
+        if (i == winner) {
+            tally.setValue(key + "/wins", tally.value(key + "/wins", 0).toInt() + 1);
+            tally.setValue(key + "/msecs", tally.value(key + "/msecs", 0).toLongLong() + elapsed);
+        } else if (!racers[i].done) {
+            tally.setValue(key + "/killed", tally.value(key + "/killed", 0).toInt() + 1);
+        }
+    }
+    return winner >= 0;
+}
+
+
+void Compiler::printRaceTally()
+{
+    QSettings tally(cacheDirPath() + "/race.ini", QSettings::IniFormat);
+    int races = tally.value("races", 0).toInt();
+    print() << "races: " << races << endl;
+
+    // the latency of all the runs is a lower bound when losers were killed
+    for (const auto &key : tally.childGroups()) {
+        int wins = tally.value(key + "/wins", 0).toInt();
+        qint64 msecs = tally.value(key + "/msecs", 0).toLongLong();
+        int runs = tally.value(key + "/runs", 0).toInt();
+        qint64 latency = tally.value(key + "/latency", 0).toLongLong();
+        int killed = tally.value(key + "/killed", 0).toInt();
+        print() << QString(" %1  wins: %2 (%3%)  avg latency: %4 ms  runs: %5  avg: %6 ms%7")
+                       .arg(key, -10)
+                       .arg(wins)
+                       .arg(races ? wins * 100 / races : 0)
+                       .arg(wins ? msecs / wins : 0)
+                       .arg(runs)
+                       .arg(runs ? latency / runs : 0)
+                       .arg(killed ? QString(" (%1 killed, at least)").arg(killed) : QString())
+                << endl;
+    }
+}
+
+
+// Compiles the source into the program, racing the compilers if configured
+bool Compiler::compileProgram(const QString &cc, const QStringList &ccOptions, const QString &src)
+{
+    bool cpl = false;
+    QStringList options = ccOptions;
+#ifndef Q_OS_WIN
+    if (_profile) {
+        options << Profiler::compileOptions();
+    }
+    if (_heapProfile) {
+        options << HeapProfiler::compileOptions();
+    }
 #endif
+    _objects.clear();
+    _dependencies.clear();
+    _interruption.clear();
+    _startTime = -1;
+    _firstOutputTime = -1;
+    _runTime = -1;
+    _allocatorName = "default";
+
+    QElapsedTimer compileTimer;
+    compileTimer.start();
+    if (!_sources.isEmpty() && !compileSources(cc, options, _objects)) {
+        return false;
+    }
+
+    // objects of other translation units are built by the compiler
+    const QStringList racers = (_cxxSpecified || !_sources.isEmpty()) ? QStringList() : raceCompilers();
 
-            qApp->processEvents();
+    if (!racers.isEmpty()) {
+        cpl = race(racers, options, src);
+    } else {
+        QStringList ccOpts;
+        if (!buildOptions(cc, options, src, aoutName(), ccOpts)) {
+            return false;
         }
+        cpl = compile(cc, ccOpts, src);
 
-        // stdout raw data
-        QByteArray rest = exe.readAll();
-        if (!rest.isEmpty()) {
-            std::cout.write(rest.constData(), rest.size());
-            std::cout.flush();
+        if (_trackDependencies) {
+#ifdef Q_CC_MSVC
+            const QString depfile = aoutName() + ".json";
+#else
+            const QString depfile = aoutName() + ".d";
+#endif
+            _dependencies << dependencyFiles(depfile);
+            QFile::remove(depfile);
         }
     }
+    _compileTime = compileTimer.elapsed();
+    return cpl;
+}
+
+
+bool Compiler::compileProgram(const QString &src)
+{
+    auto opts = cxxflags().split(" ", SkipEmptyParts);
+    opts << ldflags().split(" ", SkipEmptyParts);
+    return compileProgram(cxx(), opts, src);
+}
+
+
+// Executes the program compiled by compileProgram()
+void Compiler::executeProgram()
+{
+    if (isSetStableOption()) {
+        executeStable();
+    } else {
+        execute();
+    }
 
+    if (isSetTimingsOption()) {
+        printTimings(_compileTime, false);
+    }
     QFile::remove(aoutName());
-    return cpl ? 0 : 1;
+}
+
+
+int Compiler::compileAndExecute(const QString &cc, const QStringList &options, const QString &src)
+{
+    if (!compileProgram(cc, options, src)) {
+        if (isSetTimingsOption()) {
+            printTimings(_compileTime, false);
+        }
+        QFile::remove(aoutName());
+        return 1;
+    }
+
+    if (!_cacheScript.isEmpty()) {
+        storeBinary();
+    }
+    executeProgram();
+    return 0;
+}
+
+
+// Prints to stderr not to mix with the output of the program
+void Compiler::printTimings(qint64 compileTime, bool cached) const
+{
+    std::fprintf(stderr, ">>> timings\n");
+    std::fprintf(stderr, " compile               %lld ms%s\n", compileTime, cached ? " (cached binary)" : "");
+    if (_runTime >= 0) {
+        std::fprintf(stderr, " run                   %lld ms\n", _runTime);
+    }
+    std::fprintf(stderr, " allocator             %s\n", qUtf8Printable(_allocatorName));
+    std::fflush(stderr);
+}
+
+
+// Executes the binary cached for the file
+int Compiler::executeCached(const QString &program)
+{
+    _dependencies.clear();
+    _interruption.clear();
+    _startTime = -1;
+    _firstOutputTime = -1;
+    _runTime = -1;
+    _allocatorName = "default";
+
+    _program = program;
+    if (isSetStableOption()) {
+        executeStable();
+    } else {
+        execute();
+    }
+    _program.clear();
+
+    if (isSetTimingsOption()) {
+        printTimings(0, true);
+    }
+    return 0;
+}
+
+
+// Caches the binary built for the file with the files it depends on; it is
+// run by the cpi-run launcher too, unless it needs limits or an allocator
+void Compiler::storeBinary()
+{
+    const QString script = QFileInfo(_cacheScript).canonicalFilePath();
+    QStringList deps;
+    for (const auto &dep : _dependencies) {
+        QFileInfo fi(dep);
+        if (fi.isFile() && fi.canonicalFilePath() != script) {
+            deps << fi.absoluteFilePath();
+        }
+    }
+    if (QFileInfo(conf->fileName()).isFile()) {
+        deps << conf->fileName();  // CXXFLAGS and others
+    }
+    deps.removeDuplicates();
+
+    std::vector<std::string> files;
+    for (const auto &dep : deps) {
+        files.push_back(QFile::encodeName(dep).toStdString());
+    }
+
+    bool direct = _limits.isEmpty() && _allocator.isEmpty();
+#ifndef Q_OS_WIN
+    direct = direct && ResourceLimits::fromConfig().isEmpty() && Allocator(Allocator::fromConfig()).isEmpty();
+#endif
+
+    CacheManifest manifest(QFile::encodeName(cacheDirPath()).toStdString(), QFile::encodeName(_cacheScript).toStdString());
+    const std::string cpi = QFile::encodeName(QCoreApplication::applicationFilePath()).toStdString();
+    if (!manifest.store(QFile::encodeName(aoutName()).toStdString(), _cacheKey.toStdString(), direct, files, cpi)) {
+        qWarning() << "failed to cache the binary";
+    }
+}
+
+
+// Executes the binary; the output is discarded unless echo
+void Compiler::execute(bool echo)
+{
+    PtyProcess exe;
+#ifndef Q_OS_WIN
+    exe.setStandardInputPassThrough(_passThroughStdin);
+
+    ResourceLimits limits = ResourceLimits::fromConfig();
+    limits.parse(_limits);
+    ResourceGovernor governor(limits);
+    std::function<void()> governorModifier;
+    if (governor.prepare()) {
+        governorModifier = governor.childProcessModifier();
+    }
+
+    HeapProfiler heapProfiler;
+    const bool heapProfile = _heapProfile && echo && heapProfiler.prepare();
+    if (heapProfile) {
+        exe.setEnvironment(heapProfiler.environment());  // of the default malloc
+    } else {
+        Allocator allocator(Allocator::fromConfig() + " " + _allocator);  // the directive wins
+        if (allocator.resolve() && !allocator.isEmpty()) {
+            exe.setEnvironment(allocator.environment());
+        }
+        _allocatorName = allocator.toString();
+    }
+
+    // the profiled runs only
+    Profiler profiler;
+    std::function<void()> profilerModifier;
+    if (_profile && echo && profiler.prepare()) {
+        profilerModifier = profiler.childProcessModifier();
+    }
+
+    if (governorModifier || _childModifier || profilerModifier) {
+        exe.setChildProcessModifier([governorModifier, modifier = _childModifier, profilerModifier]() {
+            if (governorModifier) {
+                governorModifier();
+            }
+            if (modifier) {
+                modifier();
+            }
+            if (profilerModifier) {
+                profilerModifier();
+            }
+        });
+    }
+#endif
+    const qint64 begin = Tracer::globalInstance().now();
+    _startTime = steadyClock();
+    const QString program = _program.isEmpty() ? aoutName() : _program;
+    exe.start(program, cppsArgs);
+    const qint64 exepid = exe.pid();
+#ifndef Q_OS_WIN
+    if (profilerModifier) {
+        profiler.attach(exepid);
+    }
+#endif
+
+#ifdef Q_OS_WIN
+    setTerminalMode(false);
+    HANDLE stdinHandle = GetStdHandle(STD_INPUT_HANDLE);
+    QWinEventNotifier notifier(stdinHandle);
+    QObject::connect(&notifier, &QWinEventNotifier::activated, [&]() {
+        notifier.setEnabled(false);
+        auto input = readStdInput();
+        if (!input.isEmpty()) {
+            exe.write(input);
+        }
+        notifier.setEnabled(true);
+    });
+#else
+    setTerminalMode(false);
+    QSocketNotifier notifier(STDIN_FILENO, QSocketNotifier::Read);
+    notifier.setEnabled(!_passThroughStdin);
+    QObject::connect(&notifier, &QSocketNotifier::activated, [&]() {
+        notifier.setEnabled(false);
+        auto input = readStdInput(MaxPendingInput - exe.bytesToWrite());
+        if (!input.isEmpty()) {
+            exe.write(input);
+        }
+        // stops reading while the queue is full
+        notifier.setEnabled(exe.bytesToWrite() < MaxPendingInput);
+    });
+    QObject::connect(&exe, &PtyProcess::bytesWritten, [&]() {
+        if (!_passThroughStdin && exe.bytesToWrite() < MaxPendingInput) {
+            notifier.setEnabled(true);
+        }
+    });
+#endif
+
+    const int runTimeout = conf->value("RUN_TIMEOUT", 0).toInt();
+    TraceSpan drainSpan("output drain");
+    while (!exe.waitForFinished(50)) {
+        auto exeout = exe.readAll();
+        if (!exeout.isEmpty() && echo) {
+            if (_firstOutputTime < 0) {
+                _firstOutputTime = steadyClock();
+            }
+            // stdout raw data
+            std::cout.write(exeout.constData(), exeout.size());
+            std::cout.flush();
+        }
+
+        if (exe.state() != QProcess::Running) {
+            break;
+        }
+#ifndef Q_OS_WIN
+        profiler.read();
+#endif
+
+        if (interrupted(steadyClock() - _startTime, runTimeout, "program")) {
+            exe.kill();
+            if (!_interruption.isEmpty() && echo) {
+                print() << endl << _interruption << endl;
+            }
+            break;
+        }
+
+        if (gQuitRequested) {
+            exe.kill();
+            break;
+        }
+
+        qApp->processEvents();
+    }
+
+    // stdout raw data
+    QByteArray rest = exe.readAll();
+    if (!rest.isEmpty() && echo) {
+        if (_firstOutputTime < 0) {
+            _firstOutputTime = steadyClock();
+        }
+        std::cout.write(rest.constData(), rest.size());
+        std::cout.flush();
+    }
+    drainSpan.finish();
+    _runTime = steadyClock() - _startTime;
+    _usage = exe.resourceUsage();
+#ifndef Q_OS_WIN
+    if (echo) {
+        governor.printReport();
+    }
+    if (heapProfile) {
+        heapProfiler.printReport(_profileLines);
+    }
+    if (profilerModifier) {
+        profiler.read();
+        profiler.printReport(_profileLines);
+        if (!_profileFolded.isEmpty()) {
+            profiler.writeFoldedStacks(_profileFolded);
+        }
+    }
+#endif
+
+    if (Tracer::globalInstance().isEnabled()) {
+        auto &tracer = Tracer::globalInstance();
+        tracer.setProcessName(exepid, QFileInfo(program).fileName());
+        tracer.addSpan("child process", begin, tracer.now() - begin, exepid, "child");
+    }
+}
+
+
+// Runs the binary several times pinned to a CPU without ASLR, and
+// reports the run-to-run variance
+void Compiler::executeStable()
+{
+    const int warmups = std::max(conf->value("STABLE_WARMUPS", 1).toInt(), 0);
+    const int runs = std::max(conf->value("STABLE_RUNS", 5).toInt(), 1);
+
+    StableEnvironment env;
+    env.printWarnings();
+    _childModifier = env.childProcessModifier();
+
+#ifndef Q_OS_WIN
+    // every run reads the same input; a file on stdin is rewound before each
+    // run, and a pipe is read once into a file put on stdin instead
+    QTemporaryFile spool;
+    int savedStdin = -1;
+    off_t inputOffset = -1;
+    if (_passThroughStdin) {
+        inputOffset = ::lseek(STDIN_FILENO, 0, SEEK_CUR);
+        if (inputOffset < 0) {
+            if (!spool.open()) {
+                std::fprintf(stderr, ">>> failed to store the standard input for the runs\n");
+                return;
+            }
+            char buffer[65536];
+            ssize_t n;
+            while ((n = eread(STDIN_FILENO, buffer, sizeof(buffer))) > 0) {
+                spool.write(buffer, n);
+            }
+            spool.flush();
+            savedStdin = ::dup(STDIN_FILENO);
+            ::dup2(spool.handle(), STDIN_FILENO);
+            inputOffset = 0;
+        }
+    }
+#endif
+
+    QList<double> wallTimes;
+    QList<double> cpuTimes;
+    for (int i = 0; i < warmups + runs && !_canceled && _interruption.isEmpty() && !gQuitRequested; i++) {
+#ifndef Q_OS_WIN
+        if (inputOffset >= 0) {
+            ::lseek(STDIN_FILENO, inputOffset, SEEK_SET);
+        }
+#endif
+        QElapsedTimer timer;
+        timer.start();
+        execute(i == 0);  // shows the output of the first run only
+        const double wall = timer.nsecsElapsed() / 1e6;
+
+        if (i >= warmups) {
+            wallTimes << wall;
+            if (_usage.valid) {
+                cpuTimes << (_usage.userTime + _usage.systemTime) * 1000;
+            }
+        }
+    }
+    _childModifier = nullptr;
+#ifndef Q_OS_WIN
+    if (savedStdin >= 0) {
+        ::dup2(savedStdin, STDIN_FILENO);
+        ::close(savedStdin);
+    }
+#endif
+
+    StableEnvironment::printStatistics(wallTimes, cpuTimes, warmups);
 }
 
 
@@ -263,22 +1412,100 @@ int Compiler::compileAndExecute(const QString &src)
 }
 
 
+// Compiles the source into the output binary without executing it
+bool Compiler::build(const QString &src, const QString &output)
+{
+    auto opts = cxxflags().split(" ", SkipEmptyParts);
+    opts << ldflags().split(" ", SkipEmptyParts);
+
+    const QString cc = cxx();
+    QStringList ccOpts;
+    if (!buildOptions(cc, opts, src, output, ccOpts)) {
+        return false;
+    }
+    return compile(cc, ccOpts, src);
+}
+
+
+// Checks the source only, without code generation, linking and execution
+bool Compiler::checkSyntax(const QString &src)
+{
+    const QString cc = cxx();
+    QStringList ccOpts = compileFlags(cc, cxxflags().split(" ", SkipEmptyParts));
+    ccOpts << precompiledHeaderOptions(cc, ccOpts);
+#ifdef Q_CC_MSVC
+    ccOpts << "-Zs";
+#else
+    ccOpts << "-fsyntax-only" << "-";  // standard input
+#endif
+    _sourceFile = false;
+    return compile(cc, ccOpts, src);
+}
+
+
 int Compiler::compileFileAndExecute(const QString &path)
+{
+#ifndef Q_OS_WIN
+    // a file or pipe on stdin is handed to the program as is
+    _passThroughStdin = !isatty(STDIN_FILENO);
+#endif
+
+    QString cxxCmd;
+    QStringList opts;
+    QString src;
+    if (!loadSourceFile(path, cxxCmd, opts, src)) {
+        return 1;
+    }
+
+    if (isSetProfileOption()) {
+        setProfile(src.split('\n'), profileFoldedPath());
+    }
+    if (isSetHeapProfileOption()) {
+        setHeapProfile(src.split('\n'));
+    }
+
+    // a profiled binary is built with the debug information
+    if (_trackDependencies || _profile || _heapProfile || !conf->value("BINARY_CACHE", true).toBool()) {
+        return compileAndExecute(cxxCmd, opts, src);
+    }
+
+    // reuses the binary built from the same file, compiler and options
+    const QByteArray key = (cxxCmd + "\n" + opts.join("\n") + "\n" + QCoreApplication::applicationVersion()).toUtf8();
+    const QString cacheKey = QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex().left(16);
+    CacheManifest manifest(QFile::encodeName(cacheDirPath()).toStdString(), QFile::encodeName(path).toStdString());
+    // built again by another cpi, for cpi-run to find the one it runs
+    const std::string cpi = QFile::encodeName(QCoreApplication::applicationFilePath()).toStdString();
+    if (manifest.load() && manifest.key() == cacheKey.toStdString() && manifest.isBuiltBy(cpi) && manifest.isUpToDate()) {
+        return executeCached(QFile::decodeName(manifest.binaryPath().c_str()));
+    }
+
+    _cacheScript = path;
+    _cacheKey = cacheKey;
+    _trackDependencies = true;
+    int ret = compileAndExecute(cxxCmd, opts, src);
+    _trackDependencies = false;
+    _cacheScript.clear();
+    return ret;
+}
+
+
+bool Compiler::loadSourceFile(const QString &path, QString &cc, QStringList &options, QString &src)
 {
     QFile srcFile(path);
     if (!srcFile.open(QIODevice::ReadOnly)) {
         print() << "File open error, " << path << endl;
-        return 1;
+        return false;
     }
 
     QTextStream ts(&srcFile);
 #if QT_VERSION >= 0x060000
     ts.setEncoding(QStringConverter::System);
 #endif
-    QString src = ts.readLine().trimmed();  // read first line
+    src = ts.readLine().trimmed();  // read first line
 
     if (src.startsWith("#!")) {  // check shebang
-        src = ts.readAll();
+        // keeps the line numbers of the file in diagnostics
+        src = "#line 2\n" + ts.readAll();
     } else {
         src += "\n";
         src += ts.readAll();
@@ -290,6 +1517,7 @@ int Compiler::compileFileAndExecute(const QString &path)
 
     if (match.hasMatch()) {
         // Command substitution
+        TraceSpan span("substitution");
         QString options = match.captured(1);
         QStringList subsList { "`([^`]+)`", "\\$\\(([^\\)]+)\\)" };
 
@@ -301,8 +1529,12 @@ int Compiler::compileFileAndExecute(const QString &path)
                 int len = matchcs.capturedLength(0);
                 options = options.remove(pos, len);
 
+                // the same command is run only once in a process (e.g. in watch mode)
+                static QHash<QString, QString> results;
                 auto cmd = matchcs.captured(1).split(" ", SkipEmptyParts);  // Matched text
-                if (!cmd.isEmpty()) {
+                if (results.contains(matchcs.captured(1))) {
+                    options.insert(pos, results.value(matchcs.captured(1)));
+                } else if (!cmd.isEmpty()) {
                     QProcess shproc;
                     auto cmdpath = searchPath(cmd[0]);
                     if (cmdpath.isEmpty()) {
@@ -313,8 +1545,9 @@ int Compiler::compileFileAndExecute(const QString &path)
                     shproc.waitForFinished();
 
                     if (shproc.exitCode() == 0) {
-                        QByteArray out = shproc.readAllStandardOutput().trimmed();
-                        options.insert(pos, QString::fromLocal8Bit(out));
+                        QString out = QString::fromLocal8Bit(shproc.readAllStandardOutput().trimmed());
+                        results.insert(matchcs.captured(1), out);
+                        options.insert(pos, out);
                     }
                 }
 
@@ -333,11 +1566,56 @@ int Compiler::compileFileAndExecute(const QString &path)
         cxxCmd = cxxMatch.captured(1).trimmed();
     }
 
+    const QRegularExpression reLimits("//\\s*Limits\\s*:([^\n]*)", QRegularExpression::CaseInsensitiveOption);
+    _limits = reLimits.match(src).captured(1).trimmed();
+
+    const QRegularExpression reFastIO("//\\s*FastIO\\s*:\\s*(true|on|yes)\\b", QRegularExpression::CaseInsensitiveOption);
+    if (reFastIO.match(src).hasMatch()) {
+#ifdef Q_CC_MSVC
+        opts << "-DCPI_FAST_STDIO" << "-FIcpi/fastio.h";
+#else
+        opts << "-DCPI_FAST_STDIO" << "-include" << "cpi/fastio.h";
+#endif
+    }
+
+    const QRegularExpression reAllocator("//\\s*Allocator\\s*:([^\n]*)", QRegularExpression::CaseInsensitiveOption);
+    _allocator = reAllocator.match(src).captured(1).trimmed();
+
+    const QRegularExpression reSources("//\\s*Sources\\s*:([^\n]*)", QRegularExpression::CaseInsensitiveOption);
+    auto sourcesMatch = reSources.match(src);
+    _sources.clear();
+    if (sourcesMatch.hasMatch()) {
+        // relative to the directory of the file
+        QDir dir = QFileInfo(path).absoluteDir();
+        for (const auto &pattern : sourcesMatch.captured(1).split(" ", SkipEmptyParts)) {
+            QFileInfo fi(dir, pattern);
+            QStringList files;
+            if (pattern.contains(QRegularExpression("[*?\\[]"))) {
+                for (const auto &name : fi.absoluteDir().entryList(QStringList(fi.fileName()), QDir::Files, QDir::Name)) {
+                    files << fi.absoluteDir().filePath(name);
+                }
+            } else if (fi.isFile()) {
+                files << fi.absoluteFilePath();
+            }
+
+            if (files.isEmpty()) {
+                print() << "No such source file, " << pattern << endl;
+                return false;
+            }
+            _sources << files;
+        }
+        _sources.removeDuplicates();
+        _sources.removeAll(QFileInfo(path).absoluteFilePath());
+    }
+
+    _cxxSpecified = !cxxCmd.isEmpty();
     if (cxxCmd.isEmpty()) {
         cxxCmd = cxx();  // cxx command
     }
 
-    return compileAndExecute(cxxCmd, opts, src);
+    cc = cxxCmd;
+    options = opts;
+    return true;
 }
 
 
@@ -353,6 +1631,63 @@ bool Compiler::isSetQtOption()
 }
 
 
+bool Compiler::isSetRusageOption()
+{
+    return QCoreApplication::arguments().contains("--rusage");
+}
+
+
+bool Compiler::isSetStableOption()
+{
+    return QCoreApplication::arguments().contains("--stable");
+}
+
+
+bool Compiler::isSetTimingsOption()
+{
+    return QCoreApplication::arguments().contains("--timings");
+}
+
+
+bool Compiler::isSetProfileOption()
+{
+    return QCoreApplication::arguments().contains("--profile") || !profileFoldedPath().isEmpty();
+}
+
+
+// File given by --profile-folded
+QString Compiler::profileFoldedPath()
+{
+    const QStringList args = QCoreApplication::arguments();
+    int idx = args.indexOf("--profile-folded");
+    return (idx > 0) ? args.value(idx + 1) : QString();
+}
+
+
+// Samples the next executions by the profiler; the lines are of the source,
+// shown in the report
+void Compiler::setProfile(const QStringList &lines, const QString &foldedPath)
+{
+    _profile = true;
+    _profileLines = lines;
+    _profileFolded = foldedPath;
+}
+
+
+bool Compiler::isSetHeapProfileOption()
+{
+    return QCoreApplication::arguments().contains("--heap-profile");
+}
+
+
+// Counts the allocations of the next executions by the heap profiler
+void Compiler::setHeapProfile(const QStringList &lines)
+{
+    _heapProfile = true;
+    _profileLines = lines;
+}
+
+
 void Compiler::printLastCompilationError() const
 {
     print() << ">>> Compilation error\n";
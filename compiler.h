@@ -1,6 +1,12 @@
 #pragma once
 #include <QByteArray>
 #include <QString>
+#include <QStringList>
+#include <functional>
+#include "resourceusage.h"
+
+
+class QProcess;
 
 
 class Compiler {
@@ -10,19 +16,87 @@ public:
 
     int compileAndExecute(const QString &cc, const QStringList &options, const QString &src);
     int compileAndExecute(const QString &src);
+    bool compileProgram(const QString &cc, const QStringList &options, const QString &src);
+    bool compileProgram(const QString &src);
+    void executeProgram();
     int compileFileAndExecute(const QString &path);
+    bool build(const QString &src, const QString &output);
+    bool checkSyntax(const QString &src);
+    bool loadSourceFile(const QString &path, QString &cc, QStringList &options, QString &src);
     void printLastCompilationError() const;
     void printContextCompilationError() const;
+    const QString &compilationError() const { return _compileError; }
+    const ResourceUsage &lastResourceUsage() const { return _usage; }
+    void cancel() { _canceled = true; }
+    bool isCanceled() const { return _canceled; }
+    bool isInterrupted() const { return !_interruption.isEmpty(); }
+    const QString &interruption() const { return _interruption; }
+    void setTrackDependencies(bool enable) { _trackDependencies = enable; }
+    QStringList dependencies() const { return _dependencies; }
+    qint64 executionStartTime() const { return _startTime; }
+    qint64 firstOutputTime() const { return _firstOutputTime; }
+    void setProfile(const QStringList &lines, const QString &foldedPath = QString());
+    void setHeapProfile(const QStringList &lines);
 
     static bool isSetDebugOption();
     static bool isSetQtOption();
+    static bool isSetRusageOption();
+    static bool isSetStableOption();
+    static bool isSetTimingsOption();
+    static bool isSetProfileOption();
+    static QString profileFoldedPath();
+    static bool isSetHeapProfileOption();
     static QString cxx();
     static QString cxxflags();
     static QString ldflags();
+    static QStringList compileFlags(const QString &cc, const QStringList &options);
+    static QStringList precompiledHeaderOptions(const QString &cc, const QStringList &ccOpts);
+    static bool isClang(const QString &cc);
+    static qint64 steadyClock();
+    static bool usesStdModule(const QString &src);
+    static QStringList raceCompilers();
+    static void printRaceTally();
 
 private:
+    bool buildOptions(const QString &cc, const QStringList &options, const QString &src, const QString &output, QStringList &ccOpts);
     bool compile(const QString &cc, const QStringList &options, const QString &code);
+    bool waitForCompiler(QProcess &proc);
+    bool interrupted(qint64 elapsed, int timeout, const QString &what);
+    bool race(const QStringList &compilers, const QStringList &options, const QString &src);
+    static QString sourceFilePath();
+    bool stdModuleOptions(const QString &cc, const QStringList &ccOpts, QStringList &moduleOpts, QStringList &objects);
+    bool compileSources(const QString &cc, const QStringList &options, QStringList &objects);
+    void execute(bool echo = true);
+    void executeStable();
+    int executeCached(const QString &program);
+    void storeBinary();
+    void printTimings(qint64 compileTime, bool cached) const;
 
     QString _sourceCode;
     QString _compileError;
+    ResourceUsage _usage;
+    bool _passThroughStdin {false};
+    bool _sourceFile {false};  // compiles a temporary file instead of stdin
+    bool _cxxSpecified {false};  // compiler specified by the CXX directive
+    QStringList _sources;  // translation units of the Sources directive
+    QStringList _objects;  // objects to link
+    QString _limits;  // resource limits of the Limits directive
+    QString _allocator;  // malloc replacement of the Allocator directive
+    QString _allocatorName {"default"};  // allocator of the last execution
+    qint64 _compileTime {0};  // of the last compileProgram()
+    std::function<void()> _childModifier;  // called in the child before exec
+    bool _canceled {false};
+    QString _interruption;  // reason why the compiler or the program was stopped
+    bool _trackDependencies {false};
+    QStringList _dependencies;  // files the build depends on
+    qint64 _startTime {-1};  // msecs of steadyClock()
+    qint64 _firstOutputTime {-1};  // msecs of steadyClock()
+    qint64 _runTime {-1};  // msecs
+    QString _program;  // binary to execute, the compiled one if empty
+    QString _cacheScript;  // file whose binary is cached
+    QString _cacheKey;  // hash of the compiler and options
+    bool _profile {false};  // samples the program by the profiler
+    bool _heapProfile {false};  // counts the allocations of the program
+    QStringList _profileLines;  // source lines shown in the profiles
+    QString _profileFolded;  // file to write the folded stacks to
 };
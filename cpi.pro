@@ -8,7 +8,7 @@ INCLUDEPATH += .
 
 windows {
   DESTDIR = $${OUT_PWD}
-  LIBS += -luser32
+  LIBS += -luser32 -lpsapi
   EXEFILE = $${OUT_PWD}/cpi.exe
   QMAKE_POST_LINK = windeployqt.exe \"$$EXEFILE\"
 } else {
@@ -20,12 +20,39 @@ windows {
 
 # Input
 SOURCES += main.cpp
+HEADERS += asmviewer.h
+SOURCES += asmviewer.cpp
+HEADERS += batchevaluator.h
+SOURCES += batchevaluator.cpp
+HEADERS += cachemanifest.h
+SOURCES += cachemanifest.cpp
 HEADERS += compiler.h
 SOURCES += compiler.cpp
 HEADERS += codegenerator.h
 SOURCES += codegenerator.cpp
+HEADERS += expressionevaluator.h
+SOURCES += expressionevaluator.cpp
+HEADERS += externtemplates.h
+SOURCES += externtemplates.cpp
+HEADERS += optreport.h
+SOURCES += optreport.cpp
 HEADERS += print.h
 SOURCES += print.cpp
+HEADERS += headerreport.h
+SOURCES += headerreport.cpp
+HEADERS += inputchecker.h
+SOURCES += inputchecker.cpp
+HEADERS += resourceusage.h
+SOURCES += resourceusage.cpp
+HEADERS += stableenvironment.h
+SOURCES += stableenvironment.cpp
+HEADERS += sessionrecorder.h
+SOURCES += sessionrecorder.cpp
+HEADERS += sessionreplayer.h
+SOURCES += sessionreplayer.cpp
+HEADERS += tracer.h
+SOURCES += tracer.cpp
+RESOURCES += runtime.qrc
 
 windows {
   HEADERS += global.h
@@ -37,4 +64,14 @@ windows {
   SOURCES += global.cpp
   HEADERS += ptyprocess.h
   SOURCES += ptyprocess.cpp
+  HEADERS += allocator.h
+  SOURCES += allocator.cpp
+  HEADERS += resourcegovernor.h
+  SOURCES += resourcegovernor.cpp
+  HEADERS += heapprofiler.h
+  SOURCES += heapprofiler.cpp
+  HEADERS += profiler.h
+  SOURCES += profiler.cpp
+  HEADERS += symbolizer.h
+  SOURCES += symbolizer.cpp
 }
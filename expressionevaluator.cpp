@@ -0,0 +1,1261 @@
+#include "expressionevaluator.h"
+#include <QtCore/QtCore>
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <locale>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Integer, floating-point and bitwise expressions over literals and scalar
+// variables declared with literal initializers are evaluated with the C++
+// typing and promotion rules, and printed the same way as the generated code
+// (CPI_SRC) prints them. Anything else is left to the compiler.
+
+namespace {
+
+enum class Type {
+    Bool,
+    Char,
+    UChar,
+    Short,
+    UShort,
+    Int,
+    UInt,
+    Long,
+    ULong,
+    LongLong,
+    ULongLong,
+    Float,
+    Double,
+};
+
+struct Value {
+    Type type {Type::Int};
+    long long i {0};  // signed integer types
+    unsigned long long u {0};  // bool and unsigned integer types
+    double d {0};  // floating-point types
+};
+
+template <typename T>
+struct Tag {
+    using type = T;
+};
+
+
+template <typename F>
+bool visit(Type type, F &&f)
+{
+    switch (type) {
+    case Type::Bool:
+        return f(Tag<bool>());
+    case Type::Char:
+        return f(Tag<char>());
+    case Type::UChar:
+        return f(Tag<unsigned char>());
+    case Type::Short:
+        return f(Tag<short>());
+    case Type::UShort:
+        return f(Tag<unsigned short>());
+    case Type::Int:
+        return f(Tag<int>());
+    case Type::UInt:
+        return f(Tag<unsigned int>());
+    case Type::Long:
+        return f(Tag<long>());
+    case Type::ULong:
+        return f(Tag<unsigned long>());
+    case Type::LongLong:
+        return f(Tag<long long>());
+    case Type::ULongLong:
+        return f(Tag<unsigned long long>());
+    case Type::Float:
+        return f(Tag<float>());
+    case Type::Double:
+        return f(Tag<double>());
+    }
+    return false;
+}
+
+
+// Dispatches only the types after integral promotion
+template <typename F>
+bool visitPromoted(Type type, F &&f)
+{
+    switch (type) {
+    case Type::Int:
+        return f(Tag<int>());
+    case Type::UInt:
+        return f(Tag<unsigned int>());
+    case Type::Long:
+        return f(Tag<long>());
+    case Type::ULong:
+        return f(Tag<unsigned long>());
+    case Type::LongLong:
+        return f(Tag<long long>());
+    case Type::ULongLong:
+        return f(Tag<unsigned long long>());
+    case Type::Float:
+        return f(Tag<float>());
+    case Type::Double:
+        return f(Tag<double>());
+    default:
+        return false;
+    }
+}
+
+
+template <typename T>
+bool typeOf(Type &type)
+{
+    if constexpr (std::is_same_v<T, bool>) {
+        type = Type::Bool;
+    } else if constexpr (std::is_same_v<T, char>) {
+        type = Type::Char;
+    } else if constexpr (std::is_same_v<T, unsigned char>) {
+        type = Type::UChar;
+    } else if constexpr (std::is_same_v<T, short>) {
+        type = Type::Short;
+    } else if constexpr (std::is_same_v<T, unsigned short>) {
+        type = Type::UShort;
+    } else if constexpr (std::is_same_v<T, int>) {
+        type = Type::Int;
+    } else if constexpr (std::is_same_v<T, unsigned int>) {
+        type = Type::UInt;
+    } else if constexpr (std::is_same_v<T, long>) {
+        type = Type::Long;
+    } else if constexpr (std::is_same_v<T, unsigned long>) {
+        type = Type::ULong;
+    } else if constexpr (std::is_same_v<T, long long>) {
+        type = Type::LongLong;
+    } else if constexpr (std::is_same_v<T, unsigned long long>) {
+        type = Type::ULongLong;
+    } else if constexpr (std::is_same_v<T, float>) {
+        type = Type::Float;
+    } else if constexpr (std::is_same_v<T, double>) {
+        type = Type::Double;
+    } else {
+        return false;  // signed char, long double, etc.
+    }
+    return true;
+}
+
+
+template <typename T>
+Value make(T x)
+{
+    Value v;
+    typeOf<T>(v.type);
+    if constexpr (std::is_floating_point_v<T>) {
+        v.d = x;
+    } else if constexpr (std::is_signed_v<T>) {
+        v.i = x;
+    } else {
+        v.u = x;
+    }
+    return v;
+}
+
+
+template <typename S>
+S raw(const Value &v)
+{
+    if constexpr (std::is_floating_point_v<S>) {
+        return static_cast<S>(v.d);
+    } else if constexpr (std::is_signed_v<S>) {
+        return static_cast<S>(v.i);
+    } else {
+        return static_cast<S>(v.u);
+    }
+}
+
+
+// Implicit conversion of the value to T
+template <typename T>
+bool get(const Value &v, T &out)
+{
+    return visit(v.type, [&](auto tag) {
+        using S = typename decltype(tag)::type;
+        S s = raw<S>(v);
+
+        if constexpr (std::is_same_v<T, bool>) {
+            out = (s != 0);
+        } else if constexpr (std::is_floating_point_v<S> && !std::is_floating_point_v<T>) {
+            // undefined if the truncated value is out of range
+            if (!(s > (S)std::numeric_limits<T>::min() - 1 && s < (S)std::numeric_limits<T>::max() + 1)) {
+                return false;
+            }
+            out = static_cast<T>(s);
+        } else {
+            out = static_cast<T>(s);
+        }
+        return true;
+    });
+}
+
+
+bool convert(const Value &v, Type type, Value &out)
+{
+    return visit(type, [&](auto tag) {
+        using T = typename decltype(tag)::type;
+        T x;
+        if (!get(v, x)) {
+            return false;
+        }
+        out = make(x);
+        return true;
+    });
+}
+
+
+bool isFloating(Type t)
+{
+    return t == Type::Float || t == Type::Double;
+}
+
+
+bool isSigned(Type t)
+{
+    bool ret = false;
+    visit(t, [&](auto tag) {
+        ret = std::is_signed_v<typename decltype(tag)::type>;
+        return true;
+    });
+    return ret;
+}
+
+
+size_t sizeOf(Type t)
+{
+    size_t ret = 0;
+    visit(t, [&](auto tag) {
+        ret = sizeof(typename decltype(tag)::type);
+        return true;
+    });
+    return ret;
+}
+
+
+// Integral promotion
+Type promote(Type t)
+{
+    switch (t) {
+    case Type::Bool:
+    case Type::Char:
+    case Type::UChar:
+    case Type::Short:
+        return Type::Int;
+    case Type::UShort:
+        return (sizeof(unsigned short) < sizeof(int)) ? Type::Int : Type::UInt;
+    default:
+        return t;
+    }
+}
+
+
+int rank(Type t)
+{
+    switch (t) {
+    case Type::Int:
+    case Type::UInt:
+        return 1;
+    case Type::Long:
+    case Type::ULong:
+        return 2;
+    default:
+        return 3;
+    }
+}
+
+
+Type toUnsigned(Type t)
+{
+    switch (t) {
+    case Type::Int:
+        return Type::UInt;
+    case Type::Long:
+        return Type::ULong;
+    case Type::LongLong:
+        return Type::ULongLong;
+    default:
+        return t;
+    }
+}
+
+
+// Usual arithmetic conversions
+Type common(Type a, Type b)
+{
+    if (a == Type::Double || b == Type::Double) {
+        return Type::Double;
+    }
+    if (a == Type::Float || b == Type::Float) {
+        return Type::Float;
+    }
+
+    a = promote(a);
+    b = promote(b);
+    if (a == b) {
+        return a;
+    }
+
+    if (isSigned(a) == isSigned(b)) {
+        return (rank(a) >= rank(b)) ? a : b;
+    }
+
+    Type s = isSigned(a) ? a : b;
+    Type u = isSigned(a) ? b : a;
+    if (rank(u) >= rank(s)) {
+        return u;
+    }
+    if (sizeOf(s) > sizeOf(u)) {
+        return s;
+    }
+    return toUnsigned(s);
+}
+
+
+template <typename T>
+bool arithmetic(const std::string &op, T a, T b, T &r)
+{
+    constexpr T min = std::numeric_limits<T>::min();
+    constexpr T max = std::numeric_limits<T>::max();
+
+    if constexpr (std::is_floating_point_v<T>) {
+        if (op == "+") {
+            r = a + b;
+        } else if (op == "-") {
+            r = a - b;
+        } else if (op == "*") {
+            r = a * b;
+        } else if (op == "/") {
+            r = a / b;
+        } else {
+            return false;
+        }
+    } else if (op == "+") {
+        if (std::is_signed_v<T> && ((b > 0 && a > max - b) || (b < 0 && a < min - b))) {
+            return false;  // overflow
+        }
+        r = a + b;
+    } else if (op == "-") {
+        if (std::is_signed_v<T> && ((b < 0 && a > max + b) || (b > 0 && a < min + b))) {
+            return false;  // overflow
+        }
+        r = a - b;
+    } else if (op == "*") {
+        if constexpr (std::is_signed_v<T>) {
+            if (a != 0 && b != 0) {
+                if ((a > 0 && b > 0 && a > max / b) || (a > 0 && b < 0 && b < min / a)
+                    || (a < 0 && b > 0 && a < min / b) || (a < 0 && b < 0 && a < max / b)) {
+                    return false;  // overflow
+                }
+            }
+        }
+        r = a * b;
+    } else if (op == "/" || op == "%") {
+        if (b == 0 || (std::is_signed_v<T> && a == min && b == T(-1))) {
+            return false;
+        }
+        r = (op == "/") ? a / b : a % b;
+    } else if (op == "&") {
+        r = a & b;
+    } else if (op == "|") {
+        r = a | b;
+    } else if (op == "^") {
+        r = a ^ b;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+template <typename T>
+bool compare(const std::string &op, T a, T b, bool &r)
+{
+    if (op == "<") {
+        r = a < b;
+    } else if (op == ">") {
+        r = a > b;
+    } else if (op == "<=") {
+        r = a <= b;
+    } else if (op == ">=") {
+        r = a >= b;
+    } else if (op == "==") {
+        r = a == b;
+    } else if (op == "!=") {
+        r = a != b;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+bool binary(const std::string &op, const Value &a, const Value &b, Value &r)
+{
+    if (op == "<<" || op == ">>") {
+        Type lt = promote(a.type);
+        if (isFloating(lt) || isFloating(b.type)) {
+            return false;
+        }
+
+        long long count;
+        if (!get(b, count)) {
+            return false;
+        }
+
+        return visitPromoted(lt, [&](auto tag) {
+            using T = typename decltype(tag)::type;
+            if constexpr (std::is_integral_v<T>) {
+                if (count < 0 || count >= (long long)(sizeof(T) * 8)) {
+                    return false;  // undefined
+                }
+
+                T x = raw<T>(a);
+                if (op == "<<") {
+                    // modulo 2^N since C++20
+                    r = make(static_cast<T>(static_cast<std::make_unsigned_t<T>>(x) << count));
+                } else {
+                    r = make(static_cast<T>(x >> count));
+                }
+                return true;
+            }
+            return false;
+        });
+    }
+
+    Type ct = common(a.type, b.type);
+    return visitPromoted(ct, [&](auto tag) {
+        using T = typename decltype(tag)::type;
+        T x, y;
+        if (!get(a, x) || !get(b, y)) {
+            return false;
+        }
+
+        bool cmp;
+        if (compare(op, x, y, cmp)) {
+            r = make(cmp);
+            return true;
+        }
+
+        T res;
+        if (!arithmetic(op, x, y, res)) {
+            return false;
+        }
+        r = make(res);
+        return true;
+    });
+}
+
+
+bool unary(const std::string &op, const Value &v, Value &r)
+{
+    if (op == "!") {
+        bool b;
+        if (!get(v, b)) {
+            return false;
+        }
+        r = make(!b);
+        return true;
+    }
+
+    return visitPromoted(promote(v.type), [&](auto tag) {
+        using T = typename decltype(tag)::type;
+        T x;
+        if (!get(v, x)) {
+            return false;
+        }
+
+        if (op == "+") {
+            r = make(x);
+        } else if (op == "-") {
+            if constexpr (std::is_floating_point_v<T> || std::is_unsigned_v<T>) {
+                r = make(static_cast<T>(T(0) - x));
+            } else {
+                if (x == std::numeric_limits<T>::min()) {
+                    return false;  // overflow
+                }
+                r = make(static_cast<T>(-x));
+            }
+        } else if (op == "~") {
+            if constexpr (std::is_integral_v<T>) {
+                r = make(static_cast<T>(~x));
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+        return true;
+    });
+}
+
+
+std::string toString(const Value &v)
+{
+    std::ostringstream os;
+    os.imbue(std::locale::classic());
+
+    switch (v.type) {
+    case Type::Bool:
+        os << (v.u ? "true" : "false");
+        break;
+    case Type::Char:
+        os << (int)raw<char>(v);
+        break;
+    case Type::UChar:
+        os << (unsigned int)raw<unsigned char>(v);
+        break;
+    default:
+        visit(v.type, [&](auto tag) {
+            os << raw<typename decltype(tag)::type>(v);
+            return true;
+        });
+        break;
+    }
+    return os.str();
+}
+
+// ---- tokenizer ----
+
+enum class TokenKind {
+    Number,
+    Character,
+    String,
+    Identifier,
+    Punctuator,
+};
+
+struct Token {
+    TokenKind kind;
+    std::string text;
+};
+
+
+bool tokenize(const std::string &s, std::vector<Token> &tokens)
+{
+    static const char *puncts[] = {
+        "<<=", ">>=", "<=>", "...", "->*", "::",
+        "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "++", "--", "->",
+        "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=", ".*",
+    };
+
+    size_t i = 0;
+    while (i < s.size()) {
+        unsigned char c = s[i];
+
+        if (std::isspace(c)) {
+            i++;
+        } else if (s.compare(i, 2, "//") == 0) {
+            break;
+        } else if (s.compare(i, 2, "/*") == 0) {
+            size_t end = s.find("*/", i + 2);
+            if (end == std::string::npos) {
+                return false;
+            }
+            i = end + 2;
+        } else if (std::isdigit(c) || (c == '.' && i + 1 < s.size() && std::isdigit((unsigned char)s[i + 1]))) {
+            // pp-number
+            size_t j = i + 1;
+            while (j < s.size()) {
+                unsigned char d = s[j];
+                if ((d == '+' || d == '-') && std::strchr("eEpP", s[j - 1])) {
+                    j++;
+                } else if (std::isalnum(d) || d == '.' || d == '_' || (d == '\'' && j + 1 < s.size() && std::isalnum((unsigned char)s[j + 1]))) {
+                    j++;
+                } else {
+                    break;
+                }
+            }
+            tokens.push_back({TokenKind::Number, s.substr(i, j - i)});
+            i = j;
+        } else if (std::isalpha(c) || c == '_' || c >= 0x80) {
+            size_t j = i + 1;
+            while (j < s.size()) {
+                unsigned char d = s[j];
+                if (std::isalnum(d) || d == '_' || d >= 0x80) {
+                    j++;
+                } else if (s.compare(j, 2, "::") == 0 && j + 2 < s.size() && (std::isalpha((unsigned char)s[j + 2]) || s[j + 2] == '_')) {
+                    j += 2;  // qualified name
+                } else {
+                    break;
+                }
+            }
+
+            std::string word = s.substr(i, j - i);
+            if (j < s.size() && (s[j] == '\'' || s[j] == '"')) {
+                return false;  // prefixed or raw literals
+            }
+            tokens.push_back({TokenKind::Identifier, word});
+            i = j;
+        } else if (c == '\'' || c == '"') {
+            size_t j = i + 1;
+            while (j < s.size() && s[j] != (char)c) {
+                j += (s[j] == '\\') ? 2 : 1;
+            }
+            if (j >= s.size()) {
+                return false;
+            }
+            tokens.push_back({(c == '\'') ? TokenKind::Character : TokenKind::String, s.substr(i, j - i + 1)});
+            i = j + 1;
+        } else {
+            std::string p(1, (char)c);
+            for (const char *punct : puncts) {
+                if (s.compare(i, std::strlen(punct), punct) == 0) {
+                    p = punct;
+                    break;
+                }
+            }
+            tokens.push_back({TokenKind::Punctuator, p});
+            i += p.size();
+        }
+    }
+    return true;
+}
+
+// ---- literals ----
+
+bool parseInteger(std::string text, Value &v)
+{
+    text.erase(std::remove(text.begin(), text.end(), '\''), text.end());
+
+    // suffix
+    size_t end = text.size();
+    while (end > 0 && std::strchr("uUlLzZ", text[end - 1])) {
+        end--;
+    }
+    std::string suffix = text.substr(end);
+    text.resize(end);
+
+    bool isUnsigned = false;
+    int longs = 0;
+    for (size_t i = 0; i < suffix.size(); i++) {
+        char c = suffix[i];
+        if (c == 'u' || c == 'U') {
+            if (isUnsigned) {
+                return false;
+            }
+            isUnsigned = true;
+        } else if (c == 'l' || c == 'L') {
+            if (longs > 0) {
+                return false;
+            }
+            if (i + 1 < suffix.size() && suffix[i + 1] == c) {
+                longs = 2;
+                i++;
+            } else {
+                longs = 1;
+            }
+        } else {
+            return false;  // size_t literal etc.
+        }
+    }
+
+    int base = 10;
+    size_t pos = 0;
+    if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        base = 16;
+        pos = 2;
+    } else if (text.size() > 2 && text[0] == '0' && (text[1] == 'b' || text[1] == 'B')) {
+        base = 2;
+        pos = 2;
+    } else if (text.size() > 1 && text[0] == '0') {
+        base = 8;
+        pos = 1;
+    }
+
+    unsigned long long value = 0;
+    for (; pos < text.size(); pos++) {
+        char c = text[pos];
+        int digit;
+        if (std::isdigit((unsigned char)c)) {
+            digit = c - '0';
+        } else if (std::isxdigit((unsigned char)c)) {
+            digit = std::tolower(c) - 'a' + 10;
+        } else {
+            return false;
+        }
+
+        if (digit >= base || value > (std::numeric_limits<unsigned long long>::max() - digit) / base) {
+            return false;
+        }
+        value = value * base + digit;
+    }
+
+    // the first type in which the value can fit
+    std::vector<Type> candidates;
+    if (isUnsigned) {
+        if (longs == 0) {
+            candidates = {Type::UInt, Type::ULong, Type::ULongLong};
+        } else if (longs == 1) {
+            candidates = {Type::ULong, Type::ULongLong};
+        } else {
+            candidates = {Type::ULongLong};
+        }
+    } else if (base == 10) {
+        if (longs == 0) {
+            candidates = {Type::Int, Type::Long, Type::LongLong};
+        } else if (longs == 1) {
+            candidates = {Type::Long, Type::LongLong};
+        } else {
+            candidates = {Type::LongLong};
+        }
+    } else {
+        if (longs == 0) {
+            candidates = {Type::Int, Type::UInt, Type::Long, Type::ULong, Type::LongLong, Type::ULongLong};
+        } else if (longs == 1) {
+            candidates = {Type::Long, Type::ULong, Type::LongLong, Type::ULongLong};
+        } else {
+            candidates = {Type::LongLong, Type::ULongLong};
+        }
+    }
+
+    for (Type t : candidates) {
+        bool fits = false;
+        visit(t, [&](auto tag) {
+            using T = typename decltype(tag)::type;
+            fits = value <= (unsigned long long)std::numeric_limits<T>::max();
+            if (fits) {
+                v = make(static_cast<T>(value));
+            }
+            return true;
+        });
+        if (fits) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool parseNumber(std::string text, Value &v)
+{
+    bool hex = text.size() > 1 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X');
+    bool floating = !hex && text.find_first_of(".eE") != std::string::npos;
+
+    if (hex && text.find_first_of(".pP") != std::string::npos) {
+        return false;  // hexadecimal floating literal
+    }
+
+    if (!floating) {
+        return parseInteger(text, v);
+    }
+
+    text.erase(std::remove(text.begin(), text.end(), '\''), text.end());
+    char suffix = text.back();
+    if (suffix == 'l' || suffix == 'L') {
+        return false;  // long double
+    }
+    if (suffix == 'f' || suffix == 'F') {
+        text.pop_back();
+    }
+
+    std::istringstream is(text);
+    is.imbue(std::locale::classic());
+    if (suffix == 'f' || suffix == 'F') {
+        float f;
+        is >> f;
+        v = make(f);
+    } else {
+        double d;
+        is >> d;
+        v = make(d);
+    }
+    return !is.fail() && is.peek() == std::char_traits<char>::eof();
+}
+
+
+bool parseCharacter(const std::string &text, Value &v)
+{
+    std::string s = text.substr(1, text.size() - 2);
+    if (s.empty()) {
+        return false;
+    }
+
+    int c;
+    if (s[0] != '\\') {
+        if (s.size() != 1 || (unsigned char)s[0] >= 0x80) {
+            return false;  // multicharacter literal
+        }
+        c = (unsigned char)s[0];
+    } else if (s.size() == 2 && std::strchr("ntrabfv0\\'\"?", s[1])) {
+        static const std::map<char, int> escapes = {
+            {'n', '\n'}, {'t', '\t'}, {'r', '\r'}, {'a', '\a'}, {'b', '\b'}, {'f', '\f'},
+            {'v', '\v'}, {'0', 0}, {'\\', '\\'}, {'\'', '\''}, {'"', '"'}, {'?', '?'},
+        };
+        c = escapes.at(s[1]);
+    } else if (s.size() > 2 && s[1] == 'x' && s.find_first_not_of("0123456789abcdefABCDEF", 2) == std::string::npos && s.size() <= 4) {
+        c = std::stoi(s.substr(2), nullptr, 16);
+    } else if (s.find_first_not_of("01234567", 1) == std::string::npos && s.size() <= 4) {
+        c = std::stoi(s.substr(1), nullptr, 8);
+        if (c > 0xff) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    v = make(static_cast<char>(c));
+    return true;
+}
+
+// ---- parser ----
+
+class Parser {
+public:
+    Parser(const std::vector<Token> &tokens, const std::map<std::string, Value> &variables) :
+        _tokens(tokens), _vars(variables) { }
+
+    bool parseExpression(Value &v) { return conditional(v); }
+    bool parseType(Type &type);
+    bool atEnd() const { return _pos >= _tokens.size(); }
+    bool accept(const std::string &text)
+    {
+        if (!atEnd() && _tokens[_pos].text == text && _tokens[_pos].kind != TokenKind::String) {
+            _pos++;
+            return true;
+        }
+        return false;
+    }
+    const Token *peek(size_t n = 0) const { return (_pos + n < _tokens.size()) ? &_tokens[_pos + n] : nullptr; }
+    void next() { _pos++; }
+
+private:
+    bool conditional(Value &v);
+    bool binaryLevel(int level, Value &v);
+    bool unaryExpr(Value &v);
+    bool primary(Value &v);
+    bool isTypeStart() const;
+
+    const std::vector<Token> &_tokens;
+    const std::map<std::string, Value> &_vars;
+    size_t _pos {0};
+};
+
+
+const std::vector<std::vector<std::string>> binaryLevels = {
+    {"||"},
+    {"&&"},
+    {"|"},
+    {"^"},
+    {"&"},
+    {"==", "!="},
+    {"<", ">", "<=", ">="},
+    {"<<", ">>"},
+    {"+", "-"},
+    {"*", "/", "%"},
+};
+
+
+bool Parser::conditional(Value &v)
+{
+    if (!binaryLevel(0, v)) {
+        return false;
+    }
+
+    if (accept("?")) {
+        Value a, b;
+        bool cond;
+        if (!get(v, cond) || !conditional(a) || !accept(":") || !conditional(b)) {
+            return false;
+        }
+        Type t = (a.type == b.type) ? a.type : common(a.type, b.type);
+        return convert(cond ? a : b, t, v);
+    }
+    return true;
+}
+
+
+bool Parser::binaryLevel(int level, Value &v)
+{
+    if (level >= (int)binaryLevels.size()) {
+        return unaryExpr(v);
+    }
+
+    if (!binaryLevel(level + 1, v)) {
+        return false;
+    }
+
+    for (;;) {
+        const Token *tok = peek();
+        if (!tok || tok->kind != TokenKind::Punctuator) {
+            return true;
+        }
+
+        const auto &ops = binaryLevels[level];
+        if (std::find(ops.begin(), ops.end(), tok->text) == ops.end()) {
+            return true;
+        }
+
+        std::string op = tok->text;
+        next();
+
+        Value rhs;
+        if (!binaryLevel(level + 1, rhs)) {
+            return false;
+        }
+
+        if (op == "&&" || op == "||") {
+            bool a, b;
+            if (!get(v, a) || !get(rhs, b)) {
+                return false;
+            }
+            v = make(op == "&&" ? (a && b) : (a || b));
+        } else if (!binary(op, v, rhs, v)) {
+            return false;
+        }
+    }
+}
+
+
+bool Parser::unaryExpr(Value &v)
+{
+    const Token *tok = peek();
+    if (!tok) {
+        return false;
+    }
+
+    if (tok->kind == TokenKind::Punctuator && (tok->text == "+" || tok->text == "-" || tok->text == "!" || tok->text == "~")) {
+        std::string op = tok->text;
+        next();
+        Value x;
+        return unaryExpr(x) && unary(op, x, v);
+    }
+
+    // C-style cast
+    if (tok->text == "(" && peek(1) && peek(1)->kind == TokenKind::Identifier) {
+        size_t save = _pos;
+        next();
+        Type type;
+        if (isTypeStart() && parseType(type) && accept(")")) {
+            Value x;
+            return unaryExpr(x) && convert(x, type, v);
+        }
+        _pos = save;
+    }
+    return primary(v);
+}
+
+
+bool Parser::primary(Value &v)
+{
+    const Token *tok = peek();
+    if (!tok) {
+        return false;
+    }
+
+    switch (tok->kind) {
+    case TokenKind::Number:
+        next();
+        return parseNumber(tok->text, v);
+
+    case TokenKind::Character:
+        next();
+        return parseCharacter(tok->text, v);
+
+    case TokenKind::String:
+        return false;
+
+    case TokenKind::Identifier: {
+        if (tok->text == "true" || tok->text == "false") {
+            v = make(tok->text == "true");
+            next();
+            return true;
+        }
+
+        if (tok->text == "static_cast") {
+            next();
+            Type type;
+            Value x;
+            return accept("<") && parseType(type) && accept(">") && accept("(") && conditional(x) && accept(")") && convert(x, type, v);
+        }
+
+        if (isTypeStart()) {
+            // functional cast
+            Type type;
+            Value x;
+            return parseType(type) && accept("(") && conditional(x) && accept(")") && convert(x, type, v);
+        }
+
+        auto it = _vars.find(tok->text);
+        if (it == _vars.end()) {
+            return false;
+        }
+        next();
+        v = it->second;
+        return true;
+    }
+
+    case TokenKind::Punctuator:
+        if (tok->text == "(") {
+            next();
+            return conditional(v) && accept(")");
+        }
+        return false;
+    }
+    return false;
+}
+
+
+const std::map<std::string, Type> &typedefs()
+{
+    static std::map<std::string, Type> map = [] {
+        std::map<std::string, Type> m;
+        auto add = [&](auto tag, const std::string &name) {
+            Type t;
+            if (typeOf<typename decltype(tag)::type>(t)) {
+                m[name] = t;
+                m["std::" + name] = t;
+            }
+        };
+        add(Tag<std::size_t>(), "size_t");
+        add(Tag<std::ptrdiff_t>(), "ptrdiff_t");
+        add(Tag<std::int16_t>(), "int16_t");
+        add(Tag<std::int32_t>(), "int32_t");
+        add(Tag<std::int64_t>(), "int64_t");
+        add(Tag<std::uint8_t>(), "uint8_t");
+        add(Tag<std::uint16_t>(), "uint16_t");
+        add(Tag<std::uint32_t>(), "uint32_t");
+        add(Tag<std::uint64_t>(), "uint64_t");
+        add(Tag<std::intptr_t>(), "intptr_t");
+        add(Tag<std::uintptr_t>(), "uintptr_t");
+        return m;
+    }();
+    return map;
+}
+
+
+bool Parser::isTypeStart() const
+{
+    static const std::set<std::string> keywords = {"signed", "unsigned", "char", "short", "int", "long", "float", "double", "bool"};
+    const Token *tok = peek();
+    return tok && tok->kind == TokenKind::Identifier && (keywords.count(tok->text) || typedefs().count(tok->text));
+}
+
+
+bool Parser::parseType(Type &type)
+{
+    const Token *tok = peek();
+    if (!tok || tok->kind != TokenKind::Identifier) {
+        return false;
+    }
+
+    auto td = typedefs().find(tok->text);
+    if (td != typedefs().end()) {
+        next();
+        type = td->second;
+        return true;
+    }
+
+    int sign = 0, chars = 0, shorts = 0, ints = 0, longs = 0, floats = 0, doubles = 0, bools = 0;
+    while ((tok = peek()) && tok->kind == TokenKind::Identifier) {
+        const std::string &w = tok->text;
+        if (w == "signed") {
+            sign = (sign == 0) ? 1 : 9;
+        } else if (w == "unsigned") {
+            sign = (sign == 0) ? 2 : 9;
+        } else if (w == "char") {
+            chars++;
+        } else if (w == "short") {
+            shorts++;
+        } else if (w == "int") {
+            ints++;
+        } else if (w == "long") {
+            longs++;
+        } else if (w == "float") {
+            floats++;
+        } else if (w == "double") {
+            doubles++;
+        } else if (w == "bool") {
+            bools++;
+        } else {
+            break;
+        }
+        next();
+    }
+
+    if (sign == 9 || ints > 1 || chars + shorts + longs + floats + doubles + bools + ints + sign == 0) {
+        return false;
+    }
+
+    if (bools || floats || doubles) {
+        if (sign || chars || shorts || ints || longs || bools + floats + doubles > 1) {
+            return false;  // including long double
+        }
+        type = bools ? Type::Bool : (floats ? Type::Float : Type::Double);
+        return true;
+    }
+
+    if (chars) {
+        if (chars > 1 || shorts || ints || longs || sign == 1) {
+            return false;  // including signed char
+        }
+        type = (sign == 2) ? Type::UChar : Type::Char;
+        return true;
+    }
+
+    if (shorts) {
+        if (shorts > 1 || longs) {
+            return false;
+        }
+        type = (sign == 2) ? Type::UShort : Type::Short;
+        return true;
+    }
+
+    switch (longs) {
+    case 0:
+        type = (sign == 2) ? Type::UInt : Type::Int;
+        return true;
+    case 1:
+        type = (sign == 2) ? Type::ULong : Type::Long;
+        return true;
+    case 2:
+        type = (sign == 2) ? Type::ULongLong : Type::LongLong;
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+// Evaluates 'expr;'
+bool evaluateStatement(const std::vector<Token> &tokens, const std::map<std::string, Value> &vars, Value &v)
+{
+    Parser parser(tokens, vars);
+    return parser.parseExpression(v) && parser.accept(";") && parser.atEnd();
+}
+
+
+// Declaration of a scalar variable with a literal initializer
+enum class Declaration {
+    None,  // not a declaration recognized
+    Valid,
+    Unknown,  // the value of the declared variable is unknown
+};
+
+
+Declaration evaluateDeclaration(const std::vector<Token> &tokens, const std::map<std::string, Value> &vars, std::string &name, Value &v)
+{
+    static const std::set<std::string> specifiers = {"const", "constexpr", "static", "volatile", "register"};
+    Parser parser(tokens, vars);
+
+    const Token *tok;
+    while ((tok = parser.peek()) && tok->kind == TokenKind::Identifier && specifiers.count(tok->text)) {
+        parser.next();
+    }
+
+    bool deduced = parser.accept("auto");
+    Type type = Type::Int;
+    if (!deduced && !parser.parseType(type)) {
+        return Declaration::None;
+    }
+
+    tok = parser.peek();
+    if (!tok || tok->kind != TokenKind::Identifier) {
+        return Declaration::None;
+    }
+    name = tok->text;
+    parser.next();
+
+    Value init;
+    bool braced = false;
+    if (parser.accept("=")) {
+        if (parser.accept("{")) {
+            if (deduced) {
+                return Declaration::Unknown;  // std::initializer_list
+            }
+            braced = true;
+            if (!parser.parseExpression(init) || !parser.accept("}")) {
+                return Declaration::Unknown;
+            }
+        } else if (!parser.parseExpression(init)) {
+            return Declaration::Unknown;
+        }
+    } else if (parser.accept("{")) {
+        braced = true;
+        if (!parser.parseExpression(init) || !parser.accept("}")) {
+            return Declaration::Unknown;
+        }
+    } else if (parser.accept("(")) {
+        if (!parser.parseExpression(init) || !parser.accept(")")) {
+            return Declaration::Unknown;
+        }
+    } else {
+        return Declaration::Unknown;  // uninitialized
+    }
+
+    if (!parser.accept(";") || !parser.atEnd()) {
+        return Declaration::Unknown;
+    }
+
+    if (deduced) {
+        v = init;
+        return Declaration::Valid;
+    }
+
+    if (!convert(init, type, v)) {
+        return Declaration::Unknown;
+    }
+
+    if (braced) {
+        // narrowing conversion is an error
+        Value back;
+        if ((isFloating(init.type) && !isFloating(type)) || !convert(v, init.type, back)
+            || toString(back) != toString(init)) {
+            return Declaration::Unknown;
+        }
+    }
+    return Declaration::Valid;
+}
+
+}  // namespace
+
+
+bool ExpressionEvaluator::evaluate(const QStringList &headers, const QStringList &code, const QString &expression, QString &result)
+{
+    for (const auto &header : headers) {
+        QString h = header.trimmed();
+        if (h.startsWith("#") && h.mid(1).trimmed().contains(QRegularExpression("^(define|undef)\\b"))) {
+            return false;  // macros may change anything
+        }
+    }
+
+    // every code line is executed again, so all of them must be free of side effects
+    std::map<std::string, Value> vars;
+    for (const auto &line : code) {
+        std::vector<Token> tokens;
+        if (!tokenize(line.toStdString(), tokens)) {
+            return false;
+        }
+        if (tokens.empty()) {
+            continue;  // comment
+        }
+
+        std::string name;
+        Value v;
+        Declaration decl = evaluateDeclaration(tokens, vars, name, v);
+        if (decl == Declaration::Valid) {
+            vars[name] = v;
+        } else if (decl == Declaration::Unknown || !evaluateStatement(tokens, vars, v)) {
+            return false;
+        }
+    }
+
+    std::vector<Token> tokens;
+    Value v;
+    if (!tokenize(expression.toStdString(), tokens) || !evaluateStatement(tokens, vars, v)) {
+        return false;
+    }
+
+    result = QString::fromStdString(toString(v));
+    return true;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+
+
+// Evaluates constant arithmetic expressions without the compiler
+class ExpressionEvaluator {
+public:
+    static bool evaluate(const QStringList &headers, const QStringList &code, const QString &expression, QString &result);
+};
@@ -0,0 +1,171 @@
+#include "externtemplates.h"
+#include "global.h"
+#include "print.h"
+#include <QtCore/QtCore>
+using namespace cpi;
+
+// Instantiated when EXTERN_TEMPLATES=true; std::string and the iostream
+// operators are already instantiated in libstdc++ and libc++
+static const QStringList defaultTypes = {
+    "std::vector<int>",
+    "std::vector<long long>",
+    "std::vector<double>",
+    "std::vector<std::string>",
+    "std::vector<std::vector<int>>",
+    "std::map<int, int>",
+    "std::map<std::string, int>",
+    "std::set<int>",
+    "std::unordered_map<int, int>",
+    "std::unordered_map<std::string, int>",
+};
+
+static const QList<QPair<QString, QString>> headerOfTemplate = {
+    {"vector", "vector"},
+    {"deque", "deque"},
+    {"list", "list"},
+    {"forward_list", "forward_list"},
+    {"map", "map"},
+    {"multimap", "map"},
+    {"set", "set"},
+    {"multiset", "set"},
+    {"unordered_map", "unordered_map"},
+    {"unordered_multimap", "unordered_map"},
+    {"unordered_set", "unordered_set"},
+    {"unordered_multiset", "unordered_set"},
+    {"basic_string", "string"},
+    {"string", "string"},
+    {"wstring", "string"},
+    {"pair", "utility"},
+};
+
+
+// "true" for the default types, or types separated by semicolons
+QStringList ExternTemplates::types()
+{
+    // QSettings reads a value with commas as a list
+    const QString value = conf->value("EXTERN_TEMPLATES").toStringList().join(",").trimmed();
+    if (value.isEmpty() || value == "false" || value == "0") {
+        return QStringList();
+    }
+    if (value == "true" || value == "1") {
+        return defaultTypes;
+    }
+
+    QStringList list;
+    for (const auto &type : value.split(';', SkipEmptyParts)) {
+        if (!type.trimmed().isEmpty()) {
+            list << type.trimmed();
+        }
+    }
+    return list;
+}
+
+
+// Headers of the std templates named in the types
+static QString includes(const QStringList &types)
+{
+    static const QRegularExpression re("std::(\\w+)");
+    QStringList headers;
+    for (const auto &type : types) {
+        auto it = re.globalMatch(type);
+        while (it.hasNext()) {
+            const QString name = it.next().captured(1);
+            for (const auto &pair : headerOfTemplate) {
+                if (pair.first == name && !headers.contains(pair.second)) {
+                    headers << pair.second;
+                }
+            }
+        }
+    }
+
+    QString src;
+    for (const auto &header : headers) {
+        src += QString("#include <%1>\n").arg(header);
+    }
+    return src;
+}
+
+
+QString ExternTemplates::declarations()
+{
+    const QStringList list = types();
+    if (list.isEmpty()) {
+        return QString();
+    }
+
+    QString src = includes(list);
+    for (const auto &type : list) {
+        src += "extern template class " + type + ";\n";
+    }
+    return src;
+}
+
+
+// Builds the library once for each compiler and flags, and returns the path
+// of it, or an empty string if not available
+QString ExternTemplates::library(const QString &cc, const QStringList &ccOpts)
+{
+#ifdef Q_CC_MSVC
+    Q_UNUSED(cc);
+    Q_UNUSED(ccOpts);
+    return QString();
+#else
+    const QStringList list = types();
+    if (list.isEmpty()) {
+        return QString();
+    }
+
+    QString src = includes(list);
+    for (const auto &type : list) {
+        src += "template class " + type + ";\n";
+    }
+
+    static QHash<QString, QString> libraries;  // by key, empty if failed
+    const QString key = cc + "\n" + ccOpts.join("\n") + "\n" + src;
+    if (libraries.contains(key)) {
+        return libraries.value(key);
+    }
+
+    const QString dir = cacheDirPath() + "/instantiations/" + QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex().left(16);
+#ifdef Q_OS_DARWIN
+    const QString lib = dir + "/libcpiinstantiations.dylib";
+#else
+    const QString lib = dir + "/libcpiinstantiations.so";
+#endif
+
+    if (!QFileInfo(lib).exists()) {
+        // built under the names of this process and renamed, not to be
+        // loaded half written by another cpi building the same one
+        const QString tmpSuffix = QString(".%1.tmp").arg(QCoreApplication::applicationPid());
+        QDir(dir).mkpath(".");
+        QFile file(dir + "/instantiations" + tmpSuffix + ".cpp");
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            libraries.insert(key, QString());
+            return QString();
+        }
+        file.write(src.toUtf8());
+        file.close();
+
+        // linked by the absolute path, which the program loads it from
+        QStringList opts = ccOpts;
+        opts.removeAll("-xc++");
+        opts << "-fPIC" << "-shared" << file.fileName() << "-o" << lib + tmpSuffix;
+
+        print() << "Building the explicit template instantiations ..." << endl;
+        QProcess proc;
+        proc.start(cc, opts);
+        proc.waitForFinished(-1);
+        replaceFile(file.fileName(), dir + "/instantiations.cpp");
+        if (proc.exitStatus() != QProcess::NormalExit || proc.exitCode() != 0 || !replaceFile(lib + tmpSuffix, lib)) {
+            print() << "Failed to build the explicit template instantiations: " << list.join("; ") << endl;
+            print() << QString::fromLocal8Bit(proc.readAllStandardError()) << flush;
+            QFile::remove(lib + tmpSuffix);
+            libraries.insert(key, QString());
+            return QString();
+        }
+    }
+
+    libraries.insert(key, lib);
+    return lib;
+#endif
+}
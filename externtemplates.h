@@ -0,0 +1,13 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+
+
+// Explicit instantiations of common std types, built once into a shared
+// library, and the extern template declarations of them for the prelude
+class ExternTemplates {
+public:
+    static QStringList types();
+    static QString declarations();
+    static QString library(const QString &cc, const QStringList &ccOpts);
+};
@@ -2,6 +2,8 @@
 #include <termios.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <algorithm>
+#include <cstdio>
 #include <chrono>
 #include <thread>
 
@@ -46,11 +48,11 @@ void setTerminalMode(bool enableEcho)
 }
 
 
-QByteArray readStdInput()
+QByteArray readStdInput(qint64 maxSize)
 {
     const int fd = STDIN_FILENO;
     QByteArray bytes;
-    char buf[1024];
+    char buf[64 * 1024];
 
     pollfd pfd {
         .fd = fd,
@@ -58,7 +60,7 @@ QByteArray readStdInput()
         .revents = 0
     };
 
-    while (true) {
+    while (maxSize < 0 || bytes.size() < maxSize) {
         int pret = epoll(&pfd, 1, 0);
         if (pret <= 0) {
             break;
@@ -68,7 +70,12 @@ QByteArray readStdInput()
             break;
         }
 
-        ssize_t n = eread(fd, buf, sizeof(buf));
+        size_t len = sizeof(buf);
+        if (maxSize >= 0) {
+            len = std::min(len, size_t(maxSize - bytes.size()));
+        }
+
+        ssize_t n = eread(fd, buf, len);
 
         if (n <= 0) {
             break;
@@ -85,3 +92,11 @@ void Sleep(int msecs)
 {
     std::this_thread::sleep_for(std::chrono::milliseconds(msecs));
 }
+
+
+// Renames the file over the existing one atomically, so that no other
+// process sees it half-written
+bool replaceFile(const QString &from, const QString &to)
+{
+    return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+}
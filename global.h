@@ -24,10 +24,14 @@ const auto endl = Qt::endl;
 extern std::unique_ptr<QSettings> conf;
 extern QStringList cppsArgs;
 extern QString aoutName();
+extern QString cacheDirPath();
 extern std::atomic_bool gQuitRequested;
+extern std::atomic_bool gInterruptRequested;
+extern std::atomic_bool gJobRunning;
 extern void resetTerminalMode();
 extern void setTerminalMode(bool enableEcho);
-extern QByteArray readStdInput();
+extern QByteArray readStdInput(qint64 maxSize = -1);
+extern bool replaceFile(const QString &from, const QString &to);
 
 
 #ifndef Q_OS_WIN
@@ -34,7 +34,7 @@ void setTerminalMode(bool enableEcho)
 }
 
 
-QByteArray readStdInput()
+QByteArray readStdInput(qint64)
 {
     QByteArray input;
     DWORD count = 0;
@@ -80,3 +80,11 @@ QByteArray readStdInput()
 
     return input;
 }
+
+
+// Renames the file over the existing one, so that no other process sees
+// it half-written
+bool replaceFile(const QString &from, const QString &to)
+{
+    return MoveFileExW((const wchar_t *)QDir::toNativeSeparators(from).utf16(), (const wchar_t *)QDir::toNativeSeparators(to).utf16(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
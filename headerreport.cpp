@@ -0,0 +1,341 @@
+#include "headerreport.h"
+#include "compiler.h"
+#include "global.h"
+#include "print.h"
+#include <QtCore/QtCore>
+#include <algorithm>
+#include <functional>
+using namespace cpi;
+
+
+static QString includeName(const QString &line)
+{
+    static const QRegularExpression re("^\\s*#\\s*include\\s*([<\"][^>\"]+[>\"])");
+    auto match = re.match(line);
+    return match.hasMatch() ? match.captured(1) : line.trimmed();
+}
+
+
+static QString bareName(const QString &name)
+{
+    QString bare = name;
+    if (bare.startsWith('<') || bare.startsWith('"')) {
+        bare = bare.mid(1, bare.length() - 2);
+    }
+    return bare;
+}
+
+
+static QString msecs(qint64 usecs)
+{
+    return (usecs < 0) ? QString("-") : QString::number(usecs / 1000.0, 'f', 1) + " ms";
+}
+
+
+HeaderReport::HeaderReport(const QString &cc, const QStringList &options) :
+    _cc(cc), _options(options)
+{
+}
+
+
+// Returns the include lines of the source and of '-include' options
+QStringList HeaderReport::includeLines(const QString &src, const QStringList &options)
+{
+    QStringList lines;
+    const QRegularExpression re("^\\s*#\\s*include\\s*[<\"][^\n]*$", QRegularExpression::MultilineOption);
+
+    for (int i = 0; i < options.count(); i++) {
+        if (options[i] == "-include" && i + 1 < options.count()) {
+            lines << QString("#include \"%1\"").arg(options[++i]);
+        }
+    }
+
+    auto it = re.globalMatch(src);
+    while (it.hasNext()) {
+        lines << it.next().captured(0).trimmed();
+    }
+    return lines;
+}
+
+
+bool HeaderReport::analyze(const QStringList &includes)
+{
+    _headers.clear();
+    _roots.clear();
+    _total = 0;
+
+    if (includes.isEmpty()) {
+        return false;
+    }
+
+    if (Compiler::isClang(_cc) && analyzeTimeTrace(includes)) {
+        return true;
+    }
+    return analyzeByMeasurement(includes);
+}
+
+
+// Builds the tree from the '-ftime-trace' output of clang
+bool HeaderReport::analyzeTimeTrace(const QStringList &includes)
+{
+    QTemporaryDir tmpdir;
+    QString trace = tmpdir.filePath("trace.json");
+
+    QProcess proc;
+    proc.start(_cc, QStringList(_options) << "-fsyntax-only" << "-ftime-trace=" + trace << "-ftime-trace-granularity=100" << "-");
+    proc.write(includes.join("\n").toLocal8Bit() + "\n");
+    proc.closeWriteChannel();
+    proc.waitForFinished(-1);
+
+    QFile file(trace);
+    if (proc.exitCode() != 0 || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    struct Event {
+        qint64 ts;
+        qint64 dur;
+        QString file;
+    };
+
+    QList<Event> events;
+    const QJsonArray array = QJsonDocument::fromJson(file.readAll()).object().value("traceEvents").toArray();
+    for (const auto &v : array) {
+        QJsonObject obj = v.toObject();
+        if (obj.value("name").toString() == "Source" && obj.value("ph").toString() == "X") {
+            events << Event {(qint64)obj.value("ts").toDouble(), (qint64)obj.value("dur").toDouble(), obj.value("args").toObject().value("detail").toString()};
+        }
+    }
+
+    if (events.isEmpty()) {
+        return false;
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) {
+        return a.ts < b.ts || (a.ts == b.ts && a.dur > b.dur);
+    });
+
+    QList<int> stack;
+    QList<qint64> ends;  // end time of each header
+    for (const auto &ev : events) {
+        while (!stack.isEmpty() && ev.ts >= ends[stack.last()]) {
+            stack.removeLast();
+        }
+
+        Header header;
+        header.name = ev.file;
+        header.depth = stack.count();
+        header.inclusive = ev.dur;
+        _headers << header;
+        ends << ev.ts + ev.dur;
+
+        int idx = _headers.count() - 1;
+        if (stack.isEmpty()) {
+            _roots << idx;
+        } else {
+            _headers[stack.last()].children << idx;
+        }
+        stack << idx;
+    }
+
+    // exclusive time and number of nested headers
+    std::function<int(int)> finish = [&](int idx) {
+        int nested = 0;
+        qint64 children = 0;
+        for (int c : _headers[idx].children) {
+            nested += finish(c) + 1;
+            children += _headers[c].inclusive;
+        }
+        _headers[idx].nested = nested;
+        _headers[idx].exclusive = std::max<qint64>(_headers[idx].inclusive - children, 0);
+        return nested;
+    };
+
+    for (int r : _roots) {
+        finish(r);
+        _total += _headers[r].inclusive;
+
+        // names as written in the include directives
+        for (const auto &inc : includes) {
+            QString name = includeName(inc);
+            if (_headers[r].name.endsWith("/" + bareName(name)) || _headers[r].name == bareName(name)) {
+                _headers[r].name = name;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+
+// Measures the cost of each header by compiling with and without it,
+// and builds the tree from the '-H' output
+bool HeaderReport::analyzeByMeasurement(const QStringList &includes)
+{
+    QString error;
+    const qint64 base = measure(QString());
+    const qint64 all = measure(includes.join("\n"), &error);
+    if (base < 0 || all < 0) {
+        print() << error << flush;
+        return false;
+    }
+    _total = all - base;
+
+    for (int i = 0; i < includes.count(); i++) {
+        QStringList others = includes;
+        others.removeAt(i);
+
+        Header header;
+        header.name = includeName(includes[i]);
+        header.inclusive = std::max<qint64>(measure(includes[i]) - base, 0);
+        header.exclusive = std::max<qint64>(all - measure(others.join("\n")), 0);  // marginal cost
+        _headers << header;
+        _roots << _headers.count() - 1;
+    }
+
+    // include tree
+    QProcess proc;
+    proc.start(_cc, QStringList(_options) << "-fsyntax-only" << "-H" << "-");
+    proc.write(includes.join("\n").toLocal8Bit() + "\n");
+    proc.closeWriteChannel();
+    proc.waitForFinished(-1);
+
+    const QStringList lines = QString::fromLocal8Bit(proc.readAllStandardError()).split("\n", SkipEmptyParts);
+    QList<int> stack;
+    QSet<int> matched;
+    int root = -1;
+    for (const auto &line : lines) {
+        int depth = 0;
+        while (depth < line.length() && line[depth] == '.') {
+            depth++;
+        }
+        if (depth == 0) {
+            continue;  // not a header line
+        }
+
+        QString path = line.mid(depth).trimmed();
+        if (depth == 1) {
+            // matches to the next directly included header
+            stack.clear();
+            root = -1;
+            for (int r : _roots) {
+                if (!matched.contains(r) && path.endsWith("/" + bareName(_headers[r].name))) {
+                    root = r;
+                    break;
+                }
+            }
+            if (root >= 0) {
+                matched << root;
+                stack << root;
+            }
+            continue;
+        }
+
+        if (root < 0) {
+            continue;
+        }
+
+        while (stack.count() >= depth) {
+            stack.removeLast();
+        }
+
+        Header header;
+        header.name = path;
+        header.depth = depth - 1;
+        _headers << header;
+        int idx = _headers.count() - 1;
+        _headers[stack.last()].children << idx;
+        for (int s : stack) {
+            _headers[s].nested++;
+        }
+        stack << idx;
+    }
+    return true;
+}
+
+
+qint64 HeaderReport::measure(const QString &source, QString *error) const
+{
+    QElapsedTimer timer;
+    QProcess proc;
+
+    timer.start();
+    proc.start(_cc, QStringList(_options) << "-fsyntax-only" << "-");
+    proc.write(source.toLocal8Bit() + "\n");
+    proc.closeWriteChannel();
+    proc.waitForFinished(-1);
+    qint64 elapsed = timer.nsecsElapsed() / 1000;
+
+    if (proc.exitStatus() != QProcess::NormalExit || proc.exitCode() != 0) {
+        if (error) {
+            *error = QString::fromLocal8Bit(proc.readAllStandardError());
+        }
+        return -1;
+    }
+    return elapsed;
+}
+
+
+void HeaderReport::printReport() const
+{
+    QList<int> roots = _roots;
+    std::sort(roots.begin(), roots.end(), [this](int a, int b) {
+        return _headers[a].inclusive > _headers[b].inclusive;
+    });
+
+    print() << ">>> Header parse time (total " << msecs(_total) << ")" << endl;
+    print() << QString("%1 %2 %3  %4").arg("inclusive", 12).arg("exclusive", 12).arg("nested", 7).arg("header") << endl;
+    for (int r : roots) {
+        const auto &h = _headers[r];
+        print() << QString("%1 %2 %3  %4").arg(msecs(h.inclusive), 12).arg(msecs(h.exclusive), 12).arg(h.nested, 7).arg(h.name) << endl;
+    }
+
+    print() << ">>> Include tree" << endl;
+    for (int r : roots) {
+        printTree(r, 2);
+    }
+    print().flush();
+}
+
+
+void HeaderReport::printTree(int index, int maxDepth) const
+{
+    const auto &h = _headers[index];
+    QString indent(h.depth * 2, ' ');
+
+    if (h.inclusive >= 0) {
+        print() << indent << h.name << "  " << msecs(h.inclusive) << " (self " << msecs(h.exclusive) << ")" << endl;
+    } else {
+        print() << indent << h.name << "  (" << h.nested << " nested)" << endl;
+    }
+
+    if (h.depth < maxDepth) {
+        for (int c : h.children) {
+            if (_headers[c].inclusive < 0 || _headers[c].inclusive >= 1000) {  // 1ms or more
+                printTree(c, maxDepth);
+            }
+        }
+    }
+}
+
+
+// Heavy and stable (system) headers worth precompiling
+QStringList HeaderReport::recommendedHeaders() const
+{
+    QList<int> roots = _roots;
+    std::sort(roots.begin(), roots.end(), [this](int a, int b) {
+        return _headers[a].exclusive > _headers[b].exclusive;
+    });
+
+    QStringList headers;
+    for (int r : roots) {
+        const auto &h = _headers[r];
+        if (h.name.startsWith('<') && h.exclusive >= 20000 && h.exclusive * 20 >= _total) {  // 20ms and 5% or more
+            headers << h.name;
+        }
+        if (headers.count() >= 8) {
+            break;
+        }
+    }
+    return headers;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+
+class HeaderReport {
+public:
+    HeaderReport(const QString &cc, const QStringList &options);
+
+    bool analyze(const QStringList &includes);
+    void printReport() const;
+    QStringList recommendedHeaders() const;
+
+    static QStringList includeLines(const QString &src, const QStringList &options = QStringList());
+
+private:
+    struct Header {
+        QString name;  // path or name as written in the include directive
+        qint64 inclusive {-1};  // usecs, -1 if not measured
+        qint64 exclusive {-1};  // usecs, -1 if not measured
+        int depth {0};
+        int nested {0};  // number of headers included by it
+        QList<int> children;
+    };
+
+    bool analyzeTimeTrace(const QStringList &includes);
+    bool analyzeByMeasurement(const QStringList &includes);
+    qint64 measure(const QString &source, QString *error = nullptr) const;
+    void printTree(int index, int maxDepth) const;
+
+    QString _cc;
+    QStringList _options;
+    QList<Header> _headers;
+    QList<int> _roots;  // headers included directly
+    qint64 _total {0};
+};
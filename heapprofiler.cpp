@@ -0,0 +1,234 @@
+#include "heapprofiler.h"
+#include "compiler.h"
+#include "global.h"
+#include "print.h"
+#include "symbolizer.h"
+#include <QtCore/QtCore>
+#include <algorithm>
+#include <cstdio>
+using namespace cpi;
+
+constexpr int TopCount = 10;
+
+
+HeapProfiler::HeapProfiler()
+{
+    _samplePeriod = std::max(conf->value("HEAP_PROFILE_SAMPLE", 32).toInt(), 1);
+}
+
+
+HeapProfiler::~HeapProfiler()
+{
+    if (!_output.isEmpty()) {
+        QFile::remove(_output);
+    }
+}
+
+
+// Debug information to symbolize the call sites
+QStringList HeapProfiler::compileOptions()
+{
+    return QStringList {"-g"};
+}
+
+
+// Builds the interposer once for each compiler and returns the path of it,
+// or an empty string if not available
+QString HeapProfiler::library()
+{
+#ifndef Q_OS_LINUX
+    return QString();
+#else
+    static QString lib = []() {
+        QFile src(":/runtime/heapprofile.cpp");
+        if (!src.open(QIODevice::ReadOnly)) {
+            return QString();
+        }
+        const QByteArray content = src.readAll();
+        const QString cc = Compiler::cxx();
+
+        const QByteArray key = cc.toUtf8() + "\n" + content;
+        const QString dir = cacheDirPath() + "/heapprofile/" + QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex().left(16);
+        const QString path = dir + "/libcpiheapprofile.so";
+        if (QFileInfo(path).exists()) {
+            return path;
+        }
+
+        // built under the names of this process and renamed, not to be
+        // loaded half written by another cpi building the same one
+        const QString tmpSuffix = QString(".%1.tmp").arg(QCoreApplication::applicationPid());
+        QDir(dir).mkpath(".");
+        QFile file(dir + "/heapprofile" + tmpSuffix + ".cpp");
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return QString();
+        }
+        file.write(content);
+        file.close();
+
+        print() << "Building the heap profiler ..." << endl;
+        QProcess proc;
+        proc.start(cc, {"-O2", "-fPIC", "-shared", file.fileName(), "-o", path + tmpSuffix});
+        proc.waitForFinished(-1);
+        replaceFile(file.fileName(), dir + "/heapprofile.cpp");
+        if (proc.exitStatus() != QProcess::NormalExit || proc.exitCode() != 0 || !replaceFile(path + tmpSuffix, path)) {
+            print() << "Failed to build the heap profiler" << endl;
+            print() << QString::fromLocal8Bit(proc.readAllStandardError()) << flush;
+            QFile::remove(path + tmpSuffix);
+            return QString();
+        }
+        return path;
+    }();
+    return lib;
+#endif
+}
+
+
+bool HeapProfiler::prepare()
+{
+#ifndef Q_OS_LINUX
+    std::fprintf(stderr, ">>> the heap profiler is available on Linux only\n");
+    return false;
+#else
+    _library = library();
+    if (_library.isEmpty()) {
+        return false;
+    }
+    _output = QDir::tempPath() + QDir::separator() + "cpiheap" + QString::number(QCoreApplication::applicationPid()) + ".txt";
+    QFile::remove(_output);
+    return true;
+#endif
+}
+
+
+// Environment of the executed program with the interposer preloaded; it
+// calls the malloc of glibc, not that of an allocator
+QStringList HeapProfiler::environment() const
+{
+    auto env = QProcessEnvironment::systemEnvironment();
+    const QString preload = env.value("LD_PRELOAD");
+    env.insert("LD_PRELOAD", preload.isEmpty() ? _library : _library + ":" + preload);
+    env.insert("CPI_HEAP_PROFILE", _output);
+    env.insert("CPI_HEAP_SAMPLE", QString::number(_samplePeriod));
+    return env.toStringList();
+}
+
+
+static QString formatBytes(quint64 bytes)
+{
+    if (bytes >= 10 * 1024 * 1024) {
+        return QString::number(bytes / (1024 * 1024)) + " MB";
+    }
+    if (bytes >= 10 * 1024) {
+        return QString::number(bytes / 1024) + " KB";
+    }
+    return QString::number(bytes) + " B";
+}
+
+
+// Prints to stderr not to mix with the output of the program; lines are
+// those of the source compiled from standard input
+void HeapProfiler::printReport(const QStringList &lines)
+{
+    QFile file(_output);
+    if (_output.isEmpty() || !file.open(QIODevice::ReadOnly)) {
+        return;  // exited abnormally
+    }
+
+    struct Site {
+        quint64 count {0};
+        quint64 bytes {0};
+        QList<quint64> frames;  // return addresses
+    };
+
+    QHash<QString, quint64> totals;
+    QList<Site> sites;
+    Symbolizer symbolizer;
+    static const QRegularExpression reMap("^([0-9a-f]+)-([0-9a-f]+) (\\S+) ([0-9a-f]+) \\S+ \\S+\\s*(.*)$");
+    bool maps = false;
+
+    while (!file.atEnd()) {
+        const QString line = QString::fromLocal8Bit(file.readLine()).trimmed();
+        if (maps) {
+            // executable mappings of /proc/self/maps
+            auto match = reMap.match(line);
+            if (match.hasMatch() && match.captured(3).contains('x')) {
+                const quint64 address = match.captured(1).toULongLong(nullptr, 16);
+                symbolizer.addMapping({address, match.captured(2).toULongLong(nullptr, 16) - address, match.captured(4).toULongLong(nullptr, 16), match.captured(5)});
+            }
+            continue;
+        }
+
+        const QStringList fields = line.split(' ', SkipEmptyParts);
+        if (fields.value(0) == "maps") {
+            maps = true;
+        } else if (fields.value(0) == "site" && fields.count() >= 3) {
+            Site site {fields[1].toULongLong(), fields[2].toULongLong()};
+            for (const auto &field : fields.mid(3)) {
+                site.frames << field.toULongLong(nullptr, 16);
+            }
+            sites << site;
+        } else if (fields.count() == 2 && fields[0] == "peak") {
+            // signed, below zero if more is freed than allocated since the start
+            totals.insert(fields[0], quint64(std::max(fields[1].toLongLong(), 0LL)));
+        } else if (fields.count() == 2) {
+            totals.insert(fields[0], fields[1].toULongLong());
+        }
+    }
+
+    QList<quint64> addresses;
+    for (const auto &site : sites) {
+        for (quint64 frame : site.frames) {
+            addresses << frame - 1;
+        }
+    }
+    symbolizer.resolve(addresses);
+
+    // the innermost frame in the code of the user, not in a library or a
+    // standard header
+    QHash<QString, Site> callSites;
+    for (const auto &site : sites) {
+        QString location;
+        for (quint64 frame : site.frames) {
+            const auto &symbol = symbolizer.symbol(frame - 1);
+            // of the script, not the template generated around it
+            const bool script = (symbol.file == "<stdin>");
+            if (symbol.line > 0 && (script ? symbol.line <= lines.count() : !symbol.file.startsWith("/usr/"))) {
+                if (script) {
+                    location = QString("%1| %2").arg(symbol.line, 5).arg(lines.value(symbol.line - 1).trimmed());
+                } else {
+                    location = symbol.file + ":" + QString::number(symbol.line);
+                }
+                break;
+            }
+        }
+        if (location.isEmpty()) {
+            location = site.frames.isEmpty() ? QString("??") : symbolizer.symbol(site.frames.first() - 1).function;
+        }
+
+        auto &callSite = callSites[location];
+        callSite.count += site.count;
+        callSite.bytes += site.bytes;
+    }
+
+    QList<QPair<QString, Site>> sorted;
+    for (auto it = callSites.cbegin(); it != callSites.cend(); ++it) {
+        sorted << qMakePair(it.key(), it.value());
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.second.count > b.second.count; });
+
+    const quint64 period = std::max<quint64>(totals.value("sample"), 1);
+    std::fprintf(stderr, ">>> heap profile\n");
+    std::fprintf(stderr, " allocations           %llu (%llu freed)\n", totals.value("allocations"), totals.value("frees"));
+    std::fprintf(stderr, " allocated             %s\n", qUtf8Printable(formatBytes(totals.value("bytes"))));
+    std::fprintf(stderr, " peak heap             %s\n", qUtf8Printable(formatBytes(totals.value("peak"))));
+    if (!sorted.isEmpty()) {
+        if (period > 1) {
+            std::fprintf(stderr, " call sites            estimated by 1 in %llu allocations\n", period);
+        }
+        std::fprintf(stderr, "   allocs       bytes  call site\n");
+    }
+    for (const auto &pair : sorted.mid(0, TopCount)) {
+        std::fprintf(stderr, " %8llu  %10s  %s\n", pair.second.count * period, qUtf8Printable(formatBytes(pair.second.bytes * period)), qUtf8Printable(pair.first));
+    }
+    std::fflush(stderr);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+
+
+// Heap profile of the executed program by the malloc interposer preloaded
+// into it (Linux with glibc); reports the allocations, the peak heap and
+// the call sites allocating most
+class HeapProfiler {
+public:
+    HeapProfiler();
+    ~HeapProfiler();
+
+    bool prepare();
+    QStringList environment() const;
+    void printReport(const QStringList &lines);
+
+    static QStringList compileOptions();
+
+private:
+    static QString library();
+
+    QString _library;  // path of the interposer
+    QString _output;  // summary written by the program at exit
+    int _samplePeriod {32};
+};
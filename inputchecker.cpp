@@ -0,0 +1,106 @@
+#include "inputchecker.h"
+#include <QtCore/QtCore>
+
+// The input is incomplete while brackets are open, or a block comment, a raw
+// string literal or a line continuation is not closed. Errors such as an
+// extra closing bracket or an unterminated string literal make the input
+// complete, to be reported by the compiler.
+
+
+static bool isIdentifierChar(QChar c)
+{
+    return c.isLetterOrNumber() || c == '_';
+}
+
+
+// Raw string literal, such as R"(...)" or u8R"x(...)x", starting at pos
+static bool isRawStringAt(const QString &input, int pos, QString &delimiter, int &contentBegin)
+{
+    static const QRegularExpression re("(?:u8|u|U|L)?R\"([^()\\\\\\s]{0,16})\\(");
+    if (pos > 0 && isIdentifierChar(input.at(pos - 1))) {
+        return false;
+    }
+
+    auto match = re.match(input, pos, QRegularExpression::NormalMatch, QRegularExpression::AnchorAtOffsetMatchOption);
+    if (!match.hasMatch()) {
+        return false;
+    }
+    delimiter = match.captured(1);
+    contentBegin = match.capturedEnd(0);
+    return true;
+}
+
+
+bool InputChecker::isComplete(const QString &input)
+{
+    int depth = 0;  // of (), [] and {}
+    bool number = false;  // in a numeric literal, where ' is a digit separator
+    const int len = input.length();
+
+    for (int i = 0; i < len; ++i) {
+        const QChar c = input.at(i);
+        const QChar next = (i + 1 < len) ? input.at(i + 1) : QChar();
+
+        if (c == '/' && next == '/') {
+            // line comment, which may be continued by a backslash
+            while (i < len && input.at(i) != '\n') {
+                if (input.at(i) == '\\' && input.mid(i + 1).trimmed().isEmpty()) {
+                    return false;
+                }
+                ++i;
+            }
+            number = false;
+            continue;
+        }
+
+        if (c == '/' && next == '*') {
+            int end = input.indexOf("*/", i + 2);
+            if (end < 0) {
+                return false;
+            }
+            i = end + 1;
+            number = false;
+            continue;
+        }
+
+        QString delimiter;
+        int contentBegin;
+        if (!number && (c == 'R' || c == 'u' || c == 'U' || c == 'L') && isRawStringAt(input, i, delimiter, contentBegin)) {
+            int end = input.indexOf(")" + delimiter + "\"", contentBegin);
+            if (end < 0) {
+                return false;
+            }
+            i = end + delimiter.length() + 1;
+            continue;
+        }
+
+        if (c == '"' || (c == '\'' && !number)) {
+            // string or character literal, which ends at the line at most
+            for (++i; i < len && input.at(i) != c && input.at(i) != '\n'; ++i) {
+                if (input.at(i) == '\\') {
+                    ++i;
+                }
+            }
+            continue;
+        }
+
+        if (c == '\\' && input.mid(i + 1).trimmed().isEmpty()) {
+            return false;  // line continuation
+        }
+
+        if (c.isDigit() && !number) {
+            number = (i == 0) || !isIdentifierChar(input.at(i - 1));
+        } else if (!isIdentifierChar(c) && c != '\'' && c != '.') {
+            number = false;
+        }
+
+        if (c == '(' || c == '[' || c == '{') {
+            ++depth;
+        } else if (c == ')' || c == ']' || c == '}') {
+            if (--depth < 0) {
+                return true;
+            }
+        }
+    }
+    return depth == 0;
+}
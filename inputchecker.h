@@ -0,0 +1,9 @@
+#pragma once
+#include <QString>
+
+
+// Tells whether the entered code can be compiled yet, or more lines follow
+class InputChecker {
+public:
+    static bool isComplete(const QString &input);
+};
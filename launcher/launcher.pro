@@ -0,0 +1,21 @@
+TEMPLATE = app
+TARGET = cpi-run
+CONFIG += console c++17
+CONFIG -= app_bundle qt
+DEPENDPATH += . ..
+INCLUDEPATH += . ..
+
+# no loading of libstdc++ at startup
+linux {
+  QMAKE_LFLAGS += -static-libstdc++ -static-libgcc
+}
+
+isEmpty( target.path ) {
+  target.path = /usr/local/bin
+}
+INSTALLS += target
+
+# Input
+SOURCES += main.cpp
+HEADERS += ../cachemanifest.h
+SOURCES += ../cachemanifest.cpp
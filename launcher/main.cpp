@@ -0,0 +1,75 @@
+#include "cachemanifest.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+
+// Path of cpi; CPI, the one next to this launcher or the one in PATH
+static std::string findCpi(const char *argv0)
+{
+    std::string cpi = "cpi";
+    if (const char *env = std::getenv("CPI"); env && *env) {
+        cpi = env;
+    } else {
+        std::string self = argv0;
+        auto pos = self.rfind('/');
+        if (pos != std::string::npos && ::access((self.substr(0, pos + 1) + "cpi").c_str(), X_OK) == 0) {
+            return self.substr(0, pos + 1) + "cpi";
+        }
+    }
+    if (cpi.find('/') != std::string::npos) {
+        return cpi;
+    }
+
+    // searched as execvp does, to compare it with the one in the manifest
+    const char *env = std::getenv("PATH");
+    const std::string dirs = env ? env : "";
+    for (std::size_t pos = 0; pos <= dirs.size();) {
+        std::size_t end = dirs.find(':', pos);
+        if (end == std::string::npos) {
+            end = dirs.size();
+        }
+        const std::string dir = dirs.substr(pos, end - pos);
+        const std::string path = (dir.empty() ? std::string(".") : dir) + "/" + cpi;
+        if (::access(path.c_str(), X_OK) == 0) {
+            return path;
+        }
+        pos = end + 1;
+    }
+    return cpi;
+}
+
+
+// Runs cpi with the same arguments
+static int runCpi(std::string cpi, char *argv[])
+{
+    argv[0] = cpi.data();
+    ::execvp(argv[0], argv);
+    std::perror(cpi.c_str());
+    return 127;
+}
+
+
+// Launcher of cpi scripts; executes the binary cached by cpi directly
+// without starting cpi (and Qt), and runs cpi only on a cache miss or if
+// the binary was built by another cpi or an older one.
+//   #!/usr/bin/env cpi-run
+int main(int argc, char *argv[])
+{
+    const std::string cpi = findCpi(argv[0]);
+    if (argc >= 2 && argv[1][0] != '-') {
+        CacheManifest manifest(CacheManifest::defaultCacheDir(), argv[1]);
+        if (manifest.load() && manifest.isDirect() && manifest.isBuiltBy(cpi) && manifest.isUpToDate()) {
+            std::string binary = manifest.binaryPath();
+            std::vector<char *> args {binary.data()};
+            for (int i = 2; i < argc; i++) {
+                args.push_back(argv[i]);
+            }
+            args.push_back(nullptr);
+            ::execv(binary.c_str(), args.data());
+        }
+    }
+    return runCpi(cpi, argv);
+}
@@ -1,12 +1,25 @@
+#include "asmviewer.h"
+#include "batchevaluator.h"
 #include "codegenerator.h"
 #include "compiler.h"
+#include "expressionevaluator.h"
 #include "global.h"
+#include "headerreport.h"
+#include "inputchecker.h"
+#include "optreport.h"
 #include "print.h"
+#include "resourcegovernor.h"
+#include "sessionrecorder.h"
+#include "sessionreplayer.h"
+#include "tracer.h"
 #include <QtCore/QtCore>
 #include <cstdlib>
 #include <iostream>
 #include <list>
 #include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
 #ifdef Q_OS_WIN
 #include <conio.h>
 #include <windows.h>
@@ -53,12 +66,20 @@ constexpr auto DEFAULT_CONFIG = "[General]\n"
 #endif
 #endif
 
-// Entered headers and code
-static QStringList headers, code;
-static int lastLineNumber = 0;  // line number added recently
+// Entered headers and code; the main thread owns it, and the compile
+// thread works on a copy given back with the results
+struct Source {
+    QStringList headers, code;
+    int lastLineNumber {0};  // line number added recently
+};
+static Source source;
+static ResourceUsage lastUsage;  // resource usage of the last executed program
+static SessionRecorder *sessionRecorder = nullptr;  // of --record
 std::unique_ptr<QSettings> conf;
 QStringList cppsArgs;
-std::atomic_bool gQuitRequested = false;  // For windows
+std::atomic_bool gQuitRequested = false;  // by a signal, ending the loops
+std::atomic_bool gInterruptRequested = false;  // Ctrl-C while a job is running
+std::atomic_bool gJobRunning = false;  // compiling or executing the code entered
 
 
 QString aoutName()
@@ -76,9 +97,21 @@ QString aoutName()
 }
 
 
+QString cacheDirPath()
+{
+    static QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/cpi";
+    return dir;
+}
+
+
 #ifdef Q_OS_WIN
 static BOOL WINAPI signalHandler(DWORD ctrlType)
 {
+    if (ctrlType == CTRL_C_EVENT && gJobRunning) {
+        gInterruptRequested = true;  // cancels the job only
+        return TRUE;
+    }
+
     switch (ctrlType) {
     case CTRL_C_EVENT:
     case CTRL_BREAK_EVENT:
@@ -108,8 +141,20 @@ static BOOL WINAPI signalHandler(DWORD ctrlType)
 
 #else
 
-static void signalHandler(int)
+static void signalHandler(int sig)
 {
+    if (sig == SIGINT && gJobRunning) {
+        gInterruptRequested = true;  // cancels the job only
+        return;
+    }
+
+    if (ResourceGovernor::isActive()) {
+        // the program is killed, and its cgroups are removed by the governor
+        // out of the handler
+        gQuitRequested = true;
+        return;
+    }
+
     resetTerminalMode();
 
     // cleanup
@@ -139,9 +184,16 @@ static bool isAsciiAt(const QString &s, qsizetype pos)
 
 static QString isSetFileOption()
 {
+    const QStringList valueOptions {"--trace", "--eval-batch", "--profile-folded", "--record", "--replay", "--replay-timeout"};  // options taking a value
+
     QString ret;
     for (int i = 1; i < QCoreApplication::arguments().length(); i++) {
         auto opt = QCoreApplication::arguments()[i];
+        if (valueOptions.contains(opt)) {
+            i++;
+            continue;
+        }
+
         if (!opt.startsWith("-")) {
             ret = opt;
             cppsArgs = QCoreApplication::arguments().mid(i + 1);
@@ -156,9 +208,16 @@ static void showHelp()
 {
     char help[] = " .conf        Display the current values for various settings.\n"
                   " .help        Display this help.\n"
+                  " .asm [OPT]   Show the assembly of the code (OPT: O0-O3, Os or ir).\n"
+                  " .includes    Report the parse time of the included headers.\n"
+                  " .optreport   Report the vectorization of the loops in the code.\n"
+                  " .profile [FILE]\n"
+                  "              Run the code sampled by the profiler (FILE: folded stacks).\n"
+                  " .race        Show the win/loss tally of the compiler racing.\n"
                   " .rm LINENO   Remove the code of the specified line number.\n"
                   " .clear       Clear the code all.\n"
                   " .show        Show the current source code.\n"
+                  " .stats       Show the resource usage of the last executed code.\n"
                   " .quit        Exit this program.\n";
     print() << help;
 }
@@ -166,29 +225,32 @@ static void showHelp()
 
 static void showConfigs(const QSettings &conf)
 {
-    const QStringList confkeys {"CXX", "CXXFLAGS", "LDFLAGS", "COMMON_INCLUDES"};
+    const QStringList confkeys {"CXX", "CXXFLAGS", "LDFLAGS", "COMMON_INCLUDES", "PRECOMPILED_HEADERS", "EXTERN_TEMPLATES", "USE_STD_MODULE", "CXX_RACE", "FAST_EVAL", "MEMORY_MAX", "CPU_MAX", "PIDS_MAX", "CGROUP_ROOT", "STABLE_CPUS", "STABLE_ASLR", "STABLE_WARMUPS", "STABLE_RUNS", "ALLOCATOR", "ALLOCATOR_THP", "ALLOCATOR_LIBDIR", "BINARY_CACHE", "COMPILE_TIMEOUT", "RUN_TIMEOUT", "DEFER_DECLARATIONS", "PROFILE_FREQUENCY", "HEAP_PROFILE_SAMPLE"};
 
     for (auto &key : conf.allKeys()) {
-        if (confkeys.contains(key))
-            printf("%s=%s\n", qUtf8Printable(key), qUtf8Printable(conf.value(key).toString()));
+        if (confkeys.contains(key)) {
+            QVariant value = conf.value(key);
+            QString str = (value.userType() == QMetaType::QStringList) ? value.toStringList().join(",") : value.toString();
+            printf("%s=%s\n", qUtf8Printable(key), qUtf8Printable(str));
+        }
     }
 }
 
 
-static void deleteLine(int n)
+static void deleteLine(Source &src, int n)
 {
-    int h = headers.count();
-    int c = code.count();
+    int h = src.headers.count();
+    int c = src.code.count();
 
     if (n > 0) {
         if (n <= h) {
-            headers.removeAt(n - 1);
+            src.headers.removeAt(n - 1);
         } else if (n <= h + c) {
-            code.removeAt(n - h - 1);
+            src.code.removeAt(n - h - 1);
         } else {
             // ignore
         }
-        lastLineNumber = 0;
+        src.lastLineNumber = 0;
     }
 }
 
@@ -200,23 +262,129 @@ static void deleteLines(const std::list<int> &numbers)
     numlist.unique();  // removes duplicates
 
     for (auto d : numlist) {
-        deleteLine(d);
+        deleteLine(source, d);
     }
 }
 
 
+// Numbers each line of a statement continued over lines, as the compiler,
+// .profile and .asm do
 static void showCode()
 {
     int num = 1;
-    if (!headers.isEmpty()) {
-        for (int i = 0; i < headers.count(); ++i) {
-            printf("%3d| %s\n", num++, qUtf8Printable(headers.at(i)));
+    if (!source.headers.isEmpty()) {
+        for (int i = 0; i < source.headers.count(); ++i) {
+            for (const auto &line : source.headers.at(i).split('\n')) {
+                printf("%3d| %s\n", num++, qUtf8Printable(line));
+            }
         }
         printf("    --------------------\n");
     }
-    for (int i = 0; i < code.count(); ++i) {
-        printf("%3d| %s\n", num++, qUtf8Printable(code.at(i)));
+    for (int i = 0; i < source.code.count(); ++i) {
+        for (const auto &line : source.code.at(i).split('\n')) {
+            printf("%3d| %s\n", num++, qUtf8Printable(line));
+        }
+    }
+}
+
+
+// Number of the header or code line (a statement kept as one) which has
+// the line numbered by .show, or 0
+static int lineOfShownLine(int shown)
+{
+    const QStringList lines = source.headers + source.code;
+    int num = 1;
+    for (int i = 0; i < lines.count(); ++i) {
+        num += lines.at(i).count('\n') + 1;
+        if (shown < num) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+
+static QString readLine(const std::function<void(const QString &)> &idle = nullptr);
+
+
+static void showHeaderReport(const QString &cc, const QStringList &options, const QStringList &includes, bool interactive)
+{
+#ifdef Q_CC_MSVC
+    Q_UNUSED(cc);
+    Q_UNUSED(options);
+    Q_UNUSED(includes);
+    Q_UNUSED(interactive);
+    print() << "Not supported for MSVC" << endl;
+#else
+    HeaderReport report(cc, Compiler::compileFlags(cc, options));
+    if (!report.analyze(includes)) {
+        return;
+    }
+    report.printReport();
+
+    QStringList pchs = conf->value("PRECOMPILED_HEADERS").toString().split(" ", SkipEmptyParts);
+    QStringList recommended;
+    for (const auto &h : report.recommendedHeaders()) {
+        if (!pchs.contains(h) && !pchs.contains(h.mid(1, h.length() - 2))) {
+            recommended << h;
+        }
+    }
+
+    if (recommended.isEmpty()) {
+        return;
+    }
+
+    pchs << recommended;
+    if (!interactive) {
+        print() << "Precompiling them may speed up the compilation. Set in " << conf->fileName() << ":" << endl;
+        print() << "PRECOMPILED_HEADERS=" << pchs.join(" ") << endl;
+        return;
+    }
+
+    print() << "Move " << recommended.join(" ") << " into the precompiled prelude? [y/N] " << flush;
+    QString answer = readLine().trimmed();
+    if (answer.startsWith('y', Qt::CaseInsensitive)) {
+        conf->setValue("PRECOMPILED_HEADERS", pchs.join(" "));
+        conf->sync();
+        print() << "PRECOMPILED_HEADERS=" << pchs.join(" ") << endl;
+    }
+#endif
+}
+
+
+static void showOptReport(const QString &cc, const QStringList &options, const QString &src, const QStringList &lines)
+{
+#ifdef Q_CC_MSVC
+    Q_UNUSED(cc);
+    Q_UNUSED(options);
+    Q_UNUSED(src);
+    Q_UNUSED(lines);
+    print() << "Not supported for MSVC" << endl;
+#else
+    OptReport report(cc, Compiler::compileFlags(cc, options));
+    if (report.analyze(src)) {
+        report.printReport(lines);
+    }
+#endif
+}
+
+
+static void showAssembly(const QString &cc, const QStringList &options, const QString &src, const QStringList &lines, const QString &level, bool ir)
+{
+#ifdef Q_CC_MSVC
+    Q_UNUSED(cc);
+    Q_UNUSED(options);
+    Q_UNUSED(src);
+    Q_UNUSED(lines);
+    Q_UNUSED(level);
+    Q_UNUSED(ir);
+    print() << "Not supported for MSVC" << endl;
+#else
+    AsmViewer viewer(cc, Compiler::compileFlags(cc, options));
+    if (viewer.generate(src, lines.count(), level, ir)) {
+        viewer.printReport(lines);
     }
+#endif
 }
 
 
@@ -250,37 +418,255 @@ static bool waitForReadyStdInputRead(int msecs)
 }
 
 
-static void compile()
+// Declaration of variables without calls in the initializer, such as
+// "int a = 3;", "std::vector<int> v {1, 2};" or "auto f = [](int n) { ... };"
+static bool isDeclaration(const QString &line)
 {
-    if (code.isEmpty()) {
-        return;
+    static const QRegularExpression reDecl(
+        "^\\s*(?!(?:return|delete|throw|goto|case|else|do|new|co_return|co_yield|co_await)\\b)"
+        "(?:(?:const|constexpr|static|inline|unsigned|signed|long|short|volatile)\\s+)*"
+        "[A-Za-z_][\\w:]*(?:<[^;=]*>)?[\\s*&]+[A-Za-z_]\\w*\\s*(?:\\[[^\\]]*\\]\\s*)?(=|\\{|;)");
+    static const QRegularExpression reCall("[\\w>\\]]\\s*\\(");
+    static const QRegularExpression reLambda("^\\s*\\[[^\\]]*\\]");
+
+    auto match = reDecl.match(line);
+    if (!match.hasMatch() || !line.trimmed().endsWith(';')) {
+        return false;
+    }
+
+    // a call in the initializer may have side effects
+    const QString init = line.mid(match.capturedEnd(1));
+    return reLambda.match(init).hasMatch() || !reCall.match(init).hasMatch();
+}
+
+
+// Result of compiling the lines entered, reported or executed in order by
+// the main thread
+struct CompileResult {
+    std::unique_ptr<Compiler> compiler;
+    QString message;  // evaluated value or interruption
+    bool evaluated {false};  // without the compiler
+    bool error {false};  // compilation error
+    bool program {false};  // compiled to execute
+};
+
+
+static CompileResult compileLines(Source &src)
+{
+    CompileResult result;
+    if (src.code.isEmpty()) {
+        return result;
+    }
+
+    // evaluates a constant expression without the compiler
+    if (src.lastLineNumber == src.headers.count() + src.code.count() && conf->value("FAST_EVAL", true).toBool()
+        && !Compiler::isSetRusageOption()) {
+        if (ExpressionEvaluator::evaluate(src.headers, src.code.mid(0, src.code.count() - 1), src.code.last(), result.message)) {
+            result.evaluated = true;
+            return result;
+        }
     }
 
     // compile
-    CodeGenerator cdgen(headers.join("\n"), code.join("\n"));
-    QString src = cdgen.generateMainFunc();
+    CodeGenerator cdgen(src.headers.join("\n"), src.code.join("\n"));
+    QString cpp = cdgen.generateMainFunc();
+    result.compiler = std::make_unique<Compiler>();
+    Compiler &compiler = *result.compiler;
+
+    // a header or a declaration is only checked, and is run with the next
+    // line producing a value or a side effect
+    if (src.lastLineNumber > 0 && conf->value("DEFER_DECLARATIONS", true).toBool() && !Compiler::isSetRusageOption()
+        && !Compiler::usesStdModule(cpp) && !src.code.join("\n").contains(QRegularExpression(" main\\s*\\("))) {
+        const bool header = src.lastLineNumber <= src.headers.count();
+        const QString line = header ? src.headers.value(src.lastLineNumber - 1) : src.code.value(src.lastLineNumber - src.headers.count() - 1);
+
+        if (header || (isDeclaration(line) && !compiler.checkSyntax(cpp))) {
+            if (compiler.checkSyntax(cdgen.generateMainFunc(true))) {
+                return result;  // deferred
+            }
 
-    Compiler compiler;
-    int cpl = compiler.compileAndExecute(src);
-    if (cpl) {
+            result.message = compiler.interruption();
+            result.error = !compiler.isInterrupted();
+            deleteLine(src, src.lastLineNumber);
+            return result;
+        }
+    }
+
+    bool cpl = compiler.compileProgram(cpp);
+    if (!cpl && !compiler.isInterrupted()) {
         // compile only once more
-        src = cdgen.generateMainFunc(true);
-        cpl = compiler.compileAndExecute(src);
+        cpp = cdgen.generateMainFunc(true);
+        cpl = compiler.compileProgram(cpp);
+    }
+
+    if (compiler.isInterrupted()) {
+        result.message = compiler.interruption();
+        // drops the line interrupted
+        if (src.lastLineNumber > 0) {
+            deleteLine(src, src.lastLineNumber);
+        }
+        return result;
     }
 
-    if (cpl) {
-        compiler.printContextCompilationError();
-        if (!code.join("\n").contains(QRegularExpression(" main\\s*\\("))) {
+    if (!cpl) {
+        result.error = true;
+        if (!src.code.join("\n").contains(QRegularExpression(" main\\s*\\("))) {
             // delete last line
-            if (lastLineNumber > 0) {
-                deleteLine(lastLineNumber);
+            if (src.lastLineNumber > 0) {
+                deleteLine(src, src.lastLineNumber);
             }
         }
     }
-};
+    result.program = cpl;
+    return result;
+}
+
+
+static void addLines(Source &src, const QString &lines)
+{
+    // a statement continued over lines is kept as one line
+    QStringList lineList;
+    QString statement;
+    for (const auto &line : lines.split(QRegularExpression(R"(\R)"), Qt::SkipEmptyParts)) {
+        statement += statement.isEmpty() ? line : "\n" + line;
+        if (InputChecker::isComplete(statement)) {
+            lineList << statement;
+            statement.clear();
+        }
+    }
+    if (!statement.isEmpty()) {
+        lineList << statement;
+    }
+
+    for (const auto &line : lineList) {
+        if (line.startsWith('#') || line.startsWith("using ") || line.startsWith("import ")) {
+            src.headers << line;
+            src.lastLineNumber = src.headers.count();
+        } else {
+            if (!line.isEmpty()) {
+                src.code << line;
+                src.lastLineNumber = src.headers.count() + src.code.count();
+            }
+        }
+    }
+
+    if (lineList.count() > 1) {
+        // Do not delete the last line even if a compile error occurs when
+        // multiple lines are copied and pasted
+        src.lastLineNumber = 0;
+    }
+}
+
+
+// Headers and declarations print nothing, so are compiled together with
+// the input following them
+static bool isDeferrable(const QString &lines)
+{
+    for (const auto &line : lines.split(QRegularExpression(R"(\R)"), Qt::SkipEmptyParts)) {
+        if (!line.startsWith('#') && !line.startsWith("using ") && !isDeclaration(line)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Runs in the compile thread, on its copy of the source
+static std::vector<CompileResult> compileInputs(Source &src, const QStringList &inputs)
+{
+    // compiles the inputs [first, end) added to the source, into the trial
+    auto compile = [&](int first, int end, Source &trial) {
+        trial = src;
+        for (int i = first; i < end; i++) {
+            addLines(trial, inputs[i]);
+        }
+        return compileLines(trial);
+    };
+    auto compiled = [](const CompileResult &result) {
+        return !result.error && (result.evaluated || result.message.isEmpty());
+    };
+    auto interrupted = [](const CompileResult &result) {
+        return result.compiler && result.compiler->isInterrupted();
+    };
+
+    std::vector<CompileResult> results;
+    int first = 0;
+    while (first < inputs.count()) {
+        Source trial;
+        CompileResult result = compile(first, inputs.count(), trial);
+        if (compiled(result) || interrupted(result)) {
+            if (!interrupted(result)) {
+                src = trial;
+            }
+            results.push_back(std::move(result));
+            break;
+        }
+
+        // halves the inputs until the first one failing to compile after
+        // the ones compiling together, not to compile each of them
+        int good = first;  // [first, good) compile
+        int bad = inputs.count();  // [first, bad) fails
+        while (bad - good > 1) {
+            const int mid = (good + bad) / 2;
+            Source half;
+            CompileResult r = compile(first, mid, half);
+            if (interrupted(r)) {
+                results.push_back(std::move(r));
+                return results;
+            }
+            if (compiled(r)) {
+                good = mid;
+            } else {
+                bad = mid;
+                result = std::move(r);
+                trial = half;
+            }
+        }
+
+        // the error of the input, dropped from the source, and the inputs
+        // after it compiled again
+        src = trial;
+        results.push_back(std::move(result));
+        first = bad;
+    }
+    return results;
+}
+
 
+static void reportResult(CompileResult &result)
+{
+    if (!result.message.isEmpty()) {
+        print() << result.message << endl;
+    }
+    if (result.evaluated) {
+        lastUsage = ResourceUsage();
+    }
+    if (result.error) {
+        result.compiler->printContextCompilationError();
+    }
+    if (!result.program) {
+        return;
+    }
 
-static QString readLine()
+    result.compiler->executeProgram();
+    if (result.compiler->isInterrupted()) {
+        // drops the line interrupted
+        if (source.lastLineNumber > 0) {
+            deleteLine(source, source.lastLineNumber);
+        }
+        return;
+    }
+
+    lastUsage = result.compiler->lastResourceUsage();
+    if (Compiler::isSetRusageOption()) {
+        printResourceUsage(lastUsage);
+    }
+}
+
+
+// Reads a line and echoes it; idle is called with the line typed so far
+// while no key is typed
+static QString readLine(const std::function<void(const QString &)> &idle)
 {
     QString line = "";
     while (true) {
@@ -289,6 +675,9 @@ static QString readLine()
             if (gQuitRequested) {
                 return QString();
             }
+            if (idle) {
+                idle(line);
+            }
             Sleep(50);
             continue;
         }
@@ -311,6 +700,10 @@ static QString readLine()
             }
         }
     }
+
+    if (sessionRecorder) {
+        sessionRecorder->record(line);
+    }
     return line;
 }
 
@@ -327,29 +720,131 @@ static int interpreter()
         s = s.trimmed();
         if (!s.isEmpty()) {
             if (s.startsWith("<") || s.startsWith('"')) {
-                headers << QString("#include ") + s;
+                source.headers << QString("#include ") + s;
             } else {
-                headers << QString("#include <") + s + ">";
+                source.headers << QString("#include <") + s + ">";
             }
-            lastLineNumber = headers.count();
+            source.lastLineNumber = source.headers.count();
         }
     }
 
     bool end = false;
+    QString pending;  // input continued until brackets and comments are closed
+    int blankLines = 0;
+    bool pasting = false;
+
+    // The lines entered are compiled in a thread while the next ones are
+    // typed, and the results are reported and executed in order. The thread
+    // works on a copy of the source, and reads conf, which is written only
+    // by the commands after it is finished.
+    QStringList inputs;  // not compiled yet
+    std::unique_ptr<QThread> builder;
+    Source building;  // by the thread
+    std::vector<CompileResult> results;
+
+    // reported over the prompt and the line being typed, drawn again after
+    auto processInputs = [&](bool prompt, const QString &typed = QString()) {
+        if (builder) {
+            if (!builder->isFinished()) {
+                return;
+            }
+            builder.reset();
+            source = std::move(building);
+
+            if (prompt) {
+                int width = 5;  // of the prompt
+                for (int i = 0; i < typed.size(); i++) {
+                    width += isAsciiAt(typed, i) ? 1 : 2;
+                }
+                print() << '\r' << QString(width, ' ') << '\r' << flush;
+            }
+            for (auto &result : results) {
+                reportResult(result);
+            }
+            results.clear();
+
+            if (gInterruptRequested) {
+                inputs.clear();  // cancels the lines typed ahead too
+            }
+            gJobRunning = false;
+            gInterruptRequested = false;
+            if (prompt) {
+                print() << (pending.isEmpty() ? "cpi> " : "...> ") << typed << flush;
+            }
+        }
+
+        if (!inputs.isEmpty()) {
+            QStringList taken {inputs.takeFirst()};
+            if (conf->value("DEFER_DECLARATIONS", true).toBool()) {
+                while (!inputs.isEmpty() && isDeferrable(taken.last())) {
+                    taken << inputs.takeFirst();
+                }
+            }
+
+            // Ctrl-C cancels the compilation or the execution, not the session
+            gJobRunning = true;
+            building = source;
+            builder.reset(QThread::create([&results, &building, taken]() { results = compileInputs(building, taken); }));
+            builder->start();
+        }
+    };
+
+    // before the commands, which show or modify the code
+    auto finishInputs = [&]() {
+        while (builder || !inputs.isEmpty()) {
+            if (builder) {
+                builder->wait();
+            }
+            processInputs(false);
+        }
+    };
+
     auto readCodeAndCompile = [&]() {
-        QString lines = readLine();
+        // the results finished while a line is typed are reported at once
+        QString lines = readLine([&](const QString &typed) {
+            if (!pasting) {
+                processInputs(true, typed);
+            }
+        });
 
         if (lines.isNull()) {
             end = true;
             return;
         }
 
+        if (!pending.isEmpty() || !InputChecker::isComplete(lines)) {
+            blankLines = lines.trimmed().isEmpty() ? blankLines + 1 : 0;
+            pending += lines;
+            if (blankLines >= 2) {
+                // two blank lines discard the incomplete input
+                pending.clear();
+                blankLines = 0;
+                print() << "cpi> " << flush;
+                return;
+            }
+
+            if (!InputChecker::isComplete(pending)) {
+                if (!waitForReadyStdInputRead(20)) {
+                    print() << "...> " << flush;
+                }
+                return;
+            }
+            lines = pending;
+            pending.clear();
+            blankLines = 0;
+        }
+
         QString cmd = lines.trimmed();
         if (cmd == ".quit" || cmd == ".q") {
+            finishInputs();  // the lines typed ahead are run and reported
             end = true;
             return;
         }
 
+        if (cmd.startsWith('.') || cmd == "?") {
+            finishInputs();
+        }
+
         class PromptOut {
         public:
             ~PromptOut() { print() << prompt << flush; }
@@ -374,6 +869,59 @@ static int interpreter()
             return;
         }
 
+        if (cmd == ".includes") {  // reports header costs
+            auto opts = Compiler::cxxflags().split(" ", SkipEmptyParts);
+            showHeaderReport(Compiler::cxx(), opts, CodeGenerator::preludeIncludes() + HeaderReport::includeLines(source.headers.join("\n")), true);
+            return;
+        }
+
+        if (cmd == ".optreport") {  // reports optimization remarks
+            CodeGenerator cdgen(source.headers.join("\n"), source.code.join("\n"));
+            auto opts = Compiler::cxxflags().split(" ", SkipEmptyParts);
+            showOptReport(Compiler::cxx(), opts, cdgen.generateMainFunc(), (source.headers + source.code).join("\n").split('\n'));
+            return;
+        }
+
+        if (cmd == ".asm" || cmd.startsWith(".asm ")) {  // shows assembly
+            const QStringList args = cmd.split(' ', SkipEmptyParts).mid(1);
+            CodeGenerator cdgen(source.headers.join("\n"), source.code.join("\n"));
+            auto opts = Compiler::cxxflags().split(" ", SkipEmptyParts);
+            showAssembly(Compiler::cxx(), opts, cdgen.generateMainFunc(), (source.headers + source.code).join("\n").split('\n'), args.filter(QRegularExpression("^-?O")).value(0), args.contains("ir"));
+            return;
+        }
+
+        if (cmd == ".profile" || cmd.startsWith(".profile ")) {  // runs the code by the profiler
+#ifdef Q_OS_WIN
+            print() << "Not supported on Windows" << endl;
+            return;
+#endif
+            if (source.code.isEmpty()) {
+                return;
+            }
+            CodeGenerator cdgen(source.headers.join("\n"), source.code.join("\n"));
+            Compiler compiler;
+            compiler.setProfile((source.headers + source.code).join("\n").split('\n'), cmd.mid(9).trimmed());
+            gJobRunning = true;
+            if (compiler.compileProgram(cdgen.generateMainFunc(true))) {
+                compiler.executeProgram();
+            } else {
+                compiler.printContextCompilationError();
+            }
+            gJobRunning = false;
+            gInterruptRequested = false;
+            return;
+        }
+
+        if (cmd == ".race") {  // shows the tally of compiler racing
+            Compiler::printRaceTally();
+            return;
+        }
+
+        if (cmd == ".stats") {  // shows resource usage
+            printResourceUsage(lastUsage);
+            return;
+        }
+
         if (cmd.startsWith(".del ") || cmd.startsWith(".rm ")) {  // Deletes code
             int n = cmd.indexOf(' ');
             cmd.remove(0, n + 1);
@@ -382,7 +930,7 @@ static int interpreter()
             std::list<int> numbers;  // line-numbers
             for (auto &s : list) {
                 bool ok;
-                int n = s.toInt(&ok);
+                int n = lineOfShownLine(s.toInt(&ok));
                 if (ok && n > 0)
                     numbers.push_back(n);
             }
@@ -392,39 +940,23 @@ static int interpreter()
         }
 
         if (cmd == ".clear") {
-            headers.clear();
-            code.clear();
-            lastLineNumber = 0;
+            source.headers.clear();
+            source.code.clear();
+            source.lastLineNumber = 0;
             return;
         }
 
-        QStringList lineList = lines.split(QRegularExpression(R"(\R)"), Qt::SkipEmptyParts);
-        for (const auto &line : lineList) {
-            if (line.startsWith('#') || line.startsWith("using ")) {
-                headers << line;
-                lastLineNumber = headers.count();
-            } else {
-                if (!line.isEmpty()) {
-                    code << line;
-                    lastLineNumber = headers.count() + code.count();
-                }
-            }
-        }
-
-        if (lineList.count() > 1) {
-            // Do not delete the last line even if a compile error occurs when
-            // multiple lines are copied and pasted
-            lastLineNumber = 0;
+        if (pasting && !inputs.isEmpty()) {
+            inputs.last() += "\n" + lines;
+        } else {
+            inputs << lines;
         }
 
-        if (waitForReadyStdInputRead(20)) {
-            // continue reading
+        // compiles the lines pasted together
+        pasting = waitForReadyStdInputRead(20);
+        if (pasting) {
             promptOut.off();
-            return;
         }
-
-        // compile
-        compile();
     };
 
     print() << "cpi> " << flush;
@@ -434,8 +966,111 @@ static int interpreter()
         if (waitForReadyStdInputRead(50)) {
             readCodeAndCompile();
         }
+        if (!pasting) {
+            processInputs(true);
+        }
     }
 
+    // at the end of the input too
+    if (gQuitRequested) {
+        if (builder) {
+            builder->wait();
+        }
+    } else {
+        finishInputs();
+    }
+    return 0;
+}
+
+
+// Rebuilds and reruns the file whenever it or a file it depends on is modified
+static int watch(const QString &file)
+{
+    const QString path = QFileInfo(file).absoluteFilePath();
+    QFileSystemWatcher watcher;
+    Compiler *running = nullptr;
+    QStringList dependencies;  // files the build depends on
+    qint64 editTime = Compiler::steadyClock();
+    bool modified = true;
+
+    auto onModified = [&]() {
+        if (!modified) {
+            editTime = Compiler::steadyClock();
+            modified = true;
+        }
+        if (running) {
+            running->cancel();  // kills the previous instance
+        }
+    };
+
+    QObject::connect(&watcher, &QFileSystemWatcher::fileChanged, onModified);
+    QObject::connect(&watcher, &QFileSystemWatcher::directoryChanged, [&]() {
+        // the file was saved by renaming, or created again
+        if (!watcher.files().contains(path) && QFileInfo(path).exists()) {
+            onModified();
+        }
+    });
+
+    while (!gQuitRequested) {
+        if (!modified) {
+            qApp->processEvents();
+            Sleep(50);
+            continue;
+        }
+
+        // editors may write a file in several steps
+        Sleep(50);
+        qApp->processEvents();
+        modified = false;
+
+        print() << ">>> " << QTime::currentTime().toString("hh:mm:ss") << " Running " << file << endl << flush;
+        Compiler compiler;
+        compiler.setTrackDependencies(true);
+        running = &compiler;
+        int ret = compiler.compileFileAndExecute(path);
+        running = nullptr;
+
+        if (ret) {
+            compiler.printLastCompilationError();
+        } else if (compiler.executionStartTime() >= 0) {
+            print() << ">>> edit-to-run: " << compiler.executionStartTime() - editTime << " ms";
+            if (compiler.firstOutputTime() >= 0) {
+                print() << ", edit-to-output: " << compiler.firstOutputTime() - editTime << " ms";
+            }
+            if (compiler.isCanceled()) {
+                print() << " (killed)";
+            }
+            print() << endl;
+        }
+        print() << ">>> Watching for changes ..." << endl << flush;
+
+        // a failed build writes no dependency file, so the headers of the
+        // last build are watched until one succeeds again
+        if (ret == 0 && !compiler.dependencies().isEmpty()) {
+            dependencies = compiler.dependencies();
+        } else {
+            dependencies << compiler.dependencies();
+            dependencies.removeDuplicates();
+        }
+
+        // watches again, a file saved by renaming is another file
+        QStringList paths {path};
+        for (const auto &dep : dependencies) {
+            QFileInfo fi(dep);
+            if (fi.exists()) {
+                paths << fi.absoluteFilePath();
+            }
+        }
+        paths.removeDuplicates();
+
+        if (!watcher.files().isEmpty()) {
+            watcher.removePaths(watcher.files());
+        }
+        if (watcher.directories().isEmpty()) {
+            watcher.addPath(QFileInfo(path).absolutePath());
+        }
+        watcher.addPaths(paths);
+    }
     return 0;
 }
 
@@ -456,6 +1091,31 @@ int main(int argv, char *argc[])
     parser.addVersionOption();
     parser.addPositionalArgument("file", "File to compile.", "[file]");
     parser.addPositionalArgument("-", "Reads from stdin.", "[-]");
+    parser.addOption(QCommandLineOption("rusage", "Reports the resource usage of the executed program."));
+    parser.addOption(QCommandLineOption("timings", "Reports the compile and run times and the allocator."));
+    parser.addOption(QCommandLineOption("stable", "Runs the program repeatedly in a stable environment and reports the timings."));
+    parser.addOption(QCommandLineOption("emit-asm", "Shows the assembly generated for the file."));
+    parser.addOption(QCommandLineOption("emit-ir", "Shows the LLVM IR generated for the file (clang)."));
+    parser.addOption(QCommandLineOption("opt-report", "Reports the vectorization of the loops in the file."));
+    parser.addOption(QCommandLineOption("header-report", "Reports the parse time of the headers included by the file."));
+    parser.addOption(QCommandLineOption("watch", "Rebuilds and reruns the file when it or its dependencies are modified."));
+    parser.addOption(QCommandLineOption("profile", "Samples the executed program and reports the hot functions and lines."));
+    QCommandLineOption profileFoldedOption("profile-folded", "Profiles as --profile and writes the folded stacks to <file>.", "file");
+    parser.addOption(profileFoldedOption);
+    parser.addOption(QCommandLineOption("heap-profile", "Reports the heap allocations of the executed program and the call sites."));
+    QCommandLineOption traceOption("trace", "Writes a Chrome trace of the run to <file>.", "file");
+    parser.addOption(traceOption);
+    QCommandLineOption evalBatchOption("eval-batch", "Evaluates the snippets of <file> in JSON Lines with one compilation.", "file");
+    parser.addOption(evalBatchOption);
+    QCommandLineOption recordOption("record", "Records the lines typed in interactive mode with the timings to <file>.", "file");
+    parser.addOption(recordOption);
+    QCommandLineOption replayOption("replay", "Replays the session recorded in <file> on a pseudo-terminal.", "file");
+    parser.addOption(replayOption);
+    parser.addOption(QCommandLineOption("bench", "Reports the latency of each line replayed instead of the output."));
+    parser.addOption(QCommandLineOption("type-ahead", "Replays the lines at the pace recorded without waiting for the previous ones."));
+    QCommandLineOption replayTimeoutOption("replay-timeout", "Fails the replay if a line is not processed in <secs> (120 by default).", "secs");
+    parser.addOption(replayTimeoutOption);
+    parser.setOptionsAfterPositionalArgumentsMode(QCommandLineParser::ParseAsPositionalArguments);
     parser.process(app);
 
 #if (defined Q_OS_WIN) || (defined Q_OS_DARWIN)
@@ -474,6 +1134,10 @@ int main(int argv, char *argc[])
         conf->sync();
     }
 
+    if (parser.isSet(traceOption)) {
+        Tracer::globalInstance().start(parser.value(traceOption));
+    }
+
 #ifdef Q_OS_WIN
     SetConsoleCtrlHandler(signalHandler, TRUE);
 #else
@@ -485,15 +1149,61 @@ int main(int argv, char *argc[])
     try {
         Compiler compiler;
 
-        if (QString file = isSetFileOption(); !file.isEmpty()) {
+        if (parser.isSet(evalBatchOption)) {
+            BatchEvaluator batch;
+            ret = batch.run(parser.value(evalBatchOption));
+        } else if (parser.isSet(replayOption)) {
+            SessionReplayer replayer;
+            if (parser.isSet(replayTimeoutOption)) {
+                replayer.setLineTimeout(qMax(parser.value(replayTimeoutOption).toInt(), 1) * 1000);
+            }
+            replayer.setTypeAhead(QCoreApplication::arguments().contains("--type-ahead"));
+            ret = replayer.run(parser.value(replayOption), QCoreApplication::arguments().contains("--bench"));
+        } else if (QString file = isSetFileOption(); !file.isEmpty()) {
             if (!QFileInfo(file).exists()) {
                 print() << "No such file, " << file << endl;
                 return 1;
             }
 
-            ret = compiler.compileFileAndExecute(file);
-            if (ret) {
-                compiler.printLastCompilationError();
+            if (QCoreApplication::arguments().contains("--header-report")) {
+                QString cc, src;
+                QStringList opts;
+                if (!compiler.loadSourceFile(file, cc, opts, src)) {
+                    return 1;
+                }
+                showHeaderReport(cc, opts, HeaderReport::includeLines(src, opts), false);
+                return 0;
+            }
+
+            const bool emitAsm = QCoreApplication::arguments().contains("--emit-asm");
+            const bool emitIR = QCoreApplication::arguments().contains("--emit-ir");
+            if (QCoreApplication::arguments().contains("--opt-report") || emitAsm || emitIR) {
+                QString cc, src;
+                QStringList opts;
+                if (!compiler.loadSourceFile(file, cc, opts, src)) {
+                    return 1;
+                }
+
+                QFile srcFile(file);
+                srcFile.open(QIODevice::ReadOnly);
+                const QStringList lines = QString::fromLocal8Bit(srcFile.readAll()).split('\n');
+                if (emitAsm || emitIR) {
+                    showAssembly(cc, opts, src, lines, QString(), emitIR);
+                } else {
+                    showOptReport(cc, opts, src, lines);
+                }
+                return 0;
+            }
+
+            if (QCoreApplication::arguments().contains("--watch")) {
+                ret = watch(file);
+            } else {
+                ret = compiler.compileFileAndExecute(file);
+                if (ret) {
+                    compiler.printLastCompilationError();
+                } else if (Compiler::isSetRusageOption()) {
+                    printResourceUsage(compiler.lastResourceUsage());
+                }
             }
         } else if (QCoreApplication::arguments().contains("-")) {  // Check pipe option
             QString src;
@@ -505,20 +1215,37 @@ int main(int argv, char *argc[])
                 src += tsstdin.readAll();
             }
 
+            if (Compiler::isSetProfileOption()) {
+                compiler.setProfile(src.split('\n'), Compiler::profileFoldedPath());
+            }
+            if (Compiler::isSetHeapProfileOption()) {
+                compiler.setHeapProfile(src.split('\n'));
+            }
             ret = compiler.compileAndExecute(src);
             if (ret) {
                 compiler.printLastCompilationError();
+            } else if (Compiler::isSetRusageOption()) {
+                printResourceUsage(compiler.lastResourceUsage());
             }
         } else {
             // Check compiler
             Compiler::cxx();
+            SessionRecorder recorder;
+            if (parser.isSet(recordOption)) {
+                if (!recorder.open(parser.value(recordOption))) {
+                    return 1;
+                }
+                sessionRecorder = &recorder;
+            }
             ret = interpreter();
+            sessionRecorder = nullptr;
         }
 
     } catch (...) {
         ret = 1;
     }
 
+    Tracer::globalInstance().save();
     resetTerminalMode();
     return ret;
 }
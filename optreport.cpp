@@ -0,0 +1,109 @@
+#include "optreport.h"
+#include "compiler.h"
+#include "global.h"
+#include "print.h"
+#include <QtCore/QtCore>
+#include <algorithm>
+using namespace cpi;
+
+
+OptReport::OptReport(const QString &cc, const QStringList &options) :
+    _cc(cc), _options(options)
+{
+}
+
+
+// Compiles the source read from stdin, and collects the remarks on its lines;
+// the source can map the lines by #line directives
+bool OptReport::analyze(const QString &source)
+{
+    QStringList opts = _options;
+    if (opts.indexOf(QRegularExpression("^-O")) < 0) {
+        opts << "-O2";  // no vectorization without optimization
+    }
+
+    if (Compiler::isClang(_cc)) {
+        opts << "-Rpass=loop-vectorize" << "-Rpass-missed=loop-vectorize" << "-Rpass-analysis=loop-vectorize"
+             << "-fno-caret-diagnostics";
+    } else {
+        opts << "-fopt-info-vec-optimized-missed";
+    }
+
+    QProcess proc;
+    proc.start(_cc, opts << "-c" << "-o" << QProcess::nullDevice() << "-");
+    proc.write(source.toLocal8Bit() + "\n");
+    proc.closeWriteChannel();
+    proc.waitForFinished(-1);
+
+    const QString output = QString::fromLocal8Bit(proc.readAllStandardError());
+    if (proc.exitStatus() != QProcess::NormalExit || proc.exitCode() != 0) {
+        print() << output << flush;
+        return false;
+    }
+
+    // <stdin>:5:21: optimized: loop vectorized using 16 byte vectors
+    // <stdin>:5:3: remark: vectorized loop (vectorization width: 4, ...) [-Rpass=loop-vectorize]
+    static const QRegularExpression re("^<stdin>:(\\d+):(\\d+): (optimized|missed|note|remark): (.+)$");
+    static const QRegularExpression reFlag("\\s*\\[-R(pass|pass-missed|pass-analysis)=[\\w-]+\\]$");
+    _remarks.clear();
+    for (const auto &line : output.split('\n')) {
+        auto match = re.match(line);
+        if (!match.hasMatch()) {
+            continue;
+        }
+
+        Remark remark;
+        remark.line = match.captured(1).toInt();
+        remark.column = match.captured(2).toInt();
+        remark.kind = match.captured(3);
+        remark.message = match.captured(4).trimmed();
+
+        if (remark.kind == "remark") {
+            auto flag = reFlag.match(remark.message);
+            QString pass = flag.captured(1);
+            remark.kind = (pass == "pass") ? "optimized" : ((pass == "pass-missed") ? "missed" : "note");
+            remark.message.truncate(flag.hasMatch() ? flag.capturedStart() : remark.message.length());
+        }
+
+        // calls in a loop are reported for every statement
+        if (remark.message.startsWith("statement clobbers memory")) {
+            continue;
+        }
+
+        auto same = [&](const Remark &r) {
+            return r.line == remark.line && r.kind == remark.kind && r.message == remark.message;
+        };
+        if (std::none_of(_remarks.begin(), _remarks.end(), same)) {
+            _remarks << remark;
+        }
+    }
+
+    std::stable_sort(_remarks.begin(), _remarks.end(), [](const Remark &a, const Remark &b) {
+        return (a.line != b.line) ? a.line < b.line : a.column < b.column;
+    });
+    return true;
+}
+
+
+// Prints the remarks under the lines numbered from 1
+void OptReport::printReport(const QStringList &lines) const
+{
+    int count = 0;
+    int lastLine = 0;
+    for (const auto &remark : _remarks) {
+        if (remark.line < 1 || remark.line > lines.count()) {
+            continue;  // in the code generated by cpi
+        }
+
+        if (remark.line != lastLine) {
+            print() << QString("%1| ").arg(remark.line, 4) << lines[remark.line - 1] << endl;
+            lastLine = remark.line;
+        }
+        print() << QString("      %1: ").arg(remark.column, 3) << remark.kind << ": " << remark.message << endl;
+        count++;
+    }
+
+    if (!count) {
+        print() << "No optimization remarks" << endl;
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+
+// Reports the optimization remarks of the compiler (vectorization of loops)
+// next to the source lines
+class OptReport {
+public:
+    OptReport(const QString &cc, const QStringList &options);
+
+    bool analyze(const QString &source);
+    void printReport(const QStringList &lines) const;
+
+private:
+    struct Remark {
+        int line {0};
+        int column {0};
+        QString kind;  // optimized, missed or note
+        QString message;
+    };
+
+    QString _cc;
+    QStringList _options;
+    QList<Remark> _remarks;
+};
@@ -3,7 +3,7 @@
 
 Print &Print::globalInstance()
 {
-    static Print global;
+    static thread_local Print global;  // also used by the compile thread of the REPL
 #if QT_VERSION >= 0x060000
     global.setEncoding(QStringConverter::System);
 #endif
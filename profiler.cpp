@@ -0,0 +1,327 @@
+#include "profiler.h"
+#include "global.h"
+#include <QtCore/QtCore>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef Q_OS_LINUX
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+using namespace cpi;
+
+// The counter samples the main thread only; a ring buffer of a counter
+// inherited by threads can not be mapped.
+
+constexpr size_t RingPages = 256;  // read every 50 ms
+constexpr int MaxStack = 64;
+constexpr int TopCount = 15;
+
+
+Profiler::Profiler()
+{
+    _frequency = std::max(conf->value("PROFILE_FREQUENCY", 999).toInt(), 1);
+}
+
+
+Profiler::~Profiler()
+{
+    for (int fd : _pipe) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+#ifdef Q_OS_LINUX
+    if (_buffer) {
+        ::munmap(_buffer, _bufferSize);
+    }
+#endif
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+
+// Debug information to symbolize, and frame pointers to walk the stack
+QStringList Profiler::compileOptions()
+{
+    return QStringList {"-g", "-fno-omit-frame-pointer"};
+}
+
+
+bool Profiler::prepare()
+{
+#ifdef Q_OS_LINUX
+    return ::pipe2(_pipe, O_CLOEXEC) == 0;
+#else
+    std::fprintf(stderr, ">>> the profiler is available on Linux only\n");
+    return false;
+#endif
+}
+
+
+// Runs in the child process between fork and exec; waits for the counter,
+// which is enabled on exec
+std::function<void()> Profiler::childProcessModifier() const
+{
+    const int readFd = _pipe[0];
+    const int writeFd = _pipe[1];
+    return [readFd, writeFd]() {
+        ::close(writeFd);
+        char c;
+        while (::read(readFd, &c, 1) < 0 && errno == EINTR) { }
+    };
+}
+
+
+void Profiler::attach(pid_t pid)
+{
+#ifdef Q_OS_LINUX
+    perf_event_attr attr {};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_TASK_CLOCK;
+    attr.freq = 1;
+    attr.sample_freq = _frequency;
+    attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_callchain_kernel = 1;
+    attr.sample_max_stack = MaxStack;
+    attr.mmap = 1;  // executable mappings to symbolize
+
+    _fd = ::syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (_fd >= 0) {
+        _bufferSize = (RingPages + 1) * ::sysconf(_SC_PAGESIZE);
+        _buffer = ::mmap(nullptr, _bufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (_buffer == MAP_FAILED) {
+            _buffer = nullptr;
+        }
+    }
+
+    if (!_buffer) {
+        const int error = errno;
+        QFile file("/proc/sys/kernel/perf_event_paranoid");
+        QByteArray paranoid = file.open(QIODevice::ReadOnly) ? file.readAll().trimmed() : QByteArray("?");
+        std::fprintf(stderr, ">>> profiler not available: %s (kernel.perf_event_paranoid = %s)\n", std::strerror(error), paranoid.constData());
+        if (_fd >= 0) {
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+#else
+    Q_UNUSED(pid);
+#endif
+
+    // lets the child exec
+    if (_pipe[1] >= 0) {
+        (void)!::write(_pipe[1], "", 1);
+    }
+    for (int &fd : _pipe) {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+}
+
+
+// Takes the records out of the ring buffer
+void Profiler::read()
+{
+#ifdef Q_OS_LINUX
+    if (!_buffer) {
+        return;
+    }
+
+    auto *meta = static_cast<perf_event_mmap_page *>(_buffer);
+    const char *data = static_cast<const char *>(_buffer) + ::sysconf(_SC_PAGESIZE);
+    const quint64 size = RingPages * ::sysconf(_SC_PAGESIZE);
+    const quint64 head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+    quint64 tail = meta->data_tail;
+
+    // a record may wrap around the end of the buffer
+    auto copy = [&](quint64 pos, void *dst, size_t len) {
+        const size_t begin = pos % size;
+        const size_t first = std::min<size_t>(len, size - begin);
+        std::memcpy(dst, data + begin, first);
+        std::memcpy(static_cast<char *>(dst) + first, data, len - first);
+    };
+
+    QByteArray record;
+    while (tail < head) {
+        perf_event_header header;
+        copy(tail, &header, sizeof(header));
+        if (header.size < sizeof(header)) {
+            break;
+        }
+        record.resize(header.size - sizeof(header));
+        copy(tail + sizeof(header), record.data(), record.size());
+        const char *p = record.constData();
+
+        if (header.type == PERF_RECORD_SAMPLE && record.size() >= 24) {
+            // ip, pid and tid, and the call chain
+            quint64 ip, nr;
+            std::memcpy(&ip, p, 8);
+            std::memcpy(&nr, p + 16, 8);
+            std::vector<quint64> stack;
+            for (quint64 i = 0; i < nr && 24 + (i + 1) * 8 <= quint64(record.size()); i++) {
+                quint64 address;
+                std::memcpy(&address, p + 24 + i * 8, 8);
+                if (address < quint64(PERF_CONTEXT_MAX)) {
+                    stack.push_back(address);
+                }
+            }
+            if (stack.empty()) {
+                stack.push_back(ip);
+            }
+            _stacks[stack]++;
+            _samples++;
+        } else if (header.type == PERF_RECORD_MMAP && record.size() > 32) {
+            // pid and tid, address, length, file offset and path
+            Symbolizer::Mapping mapping;
+            std::memcpy(&mapping.address, p + 8, 8);
+            std::memcpy(&mapping.length, p + 16, 8);
+            std::memcpy(&mapping.offset, p + 24, 8);
+            mapping.path = QString::fromLocal8Bit(p + 32, qstrnlen(p + 32, record.size() - 32));
+            _symbolizer.addMapping(mapping);
+        } else if (header.type == PERF_RECORD_LOST && record.size() >= 16) {
+            quint64 lost;
+            std::memcpy(&lost, p + 8, 8);
+            _lost += lost;
+        }
+        tail += header.size;
+    }
+    __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+#endif
+}
+
+
+void Profiler::symbolize()
+{
+    if (_symbolized) {
+        return;
+    }
+    _symbolized = true;
+
+    QList<quint64> addresses;
+    for (const auto &entry : _stacks) {
+        for (size_t i = 0; i < entry.first.size(); i++) {
+            addresses << ((i == 0) ? entry.first[i] : entry.first[i] - 1);
+        }
+    }
+    _symbolizer.resolve(addresses);
+}
+
+
+// Return addresses point after the call
+const Symbolizer::Symbol &Profiler::symbol(const std::vector<quint64> &stack, size_t frame) const
+{
+    return _symbolizer.symbol(frame == 0 ? stack[frame] : stack[frame] - 1);
+}
+
+
+template <typename T>
+static QList<QPair<T, quint64>> sortedByCount(const QHash<T, quint64> &counts)
+{
+    QList<QPair<T, quint64>> list;
+    for (auto it = counts.cbegin(); it != counts.cend(); ++it) {
+        list << qMakePair(it.key(), it.value());
+    }
+    std::sort(list.begin(), list.end(), [](const auto &a, const auto &b) { return a.second > b.second; });
+    return list;
+}
+
+
+// Prints to stderr not to mix with the output of the program; lines are
+// those of the source compiled from standard input
+void Profiler::printReport(const QStringList &lines)
+{
+    if (_fd < 0) {
+        return;
+    }
+    symbolize();
+
+    QHash<QString, quint64> self;
+    QHash<QString, quint64> total;
+    QHash<QPair<QString, int>, quint64> lineSamples;
+    for (const auto &entry : _stacks) {
+        const Symbolizer::Symbol &leaf = symbol(entry.first, 0);
+        self[leaf.function] += entry.second;
+        // of the script, not the template generated around it
+        const bool script = (leaf.file == "<stdin>");
+        if (leaf.line > 0 && (script ? leaf.line <= lines.count() : !leaf.file.startsWith("/usr/"))) {
+            lineSamples[qMakePair(leaf.file, leaf.line)] += entry.second;
+        }
+
+        // once in a sample even if recursive
+        QSet<QString> callers;
+        for (size_t i = 0; i < entry.first.size(); i++) {
+            const QString &function = symbol(entry.first, i).function;
+            if (!callers.contains(function)) {
+                callers.insert(function);
+                total[function] += entry.second;
+            }
+        }
+    }
+
+    const double samples = std::max<quint64>(_samples, 1);
+    std::fprintf(stderr, ">>> profile (%llu samples at %d Hz", (unsigned long long)_samples, _frequency);
+    if (_lost > 0) {
+        std::fprintf(stderr, ", %llu lost", (unsigned long long)_lost);
+    }
+    std::fprintf(stderr, ")\n  self%%  total%%  function\n");
+    for (const auto &pair : sortedByCount(self).mid(0, TopCount)) {
+        std::fprintf(stderr, " %6.1f  %6.1f  %s\n", pair.second * 100 / samples, total.value(pair.first) * 100 / samples, qUtf8Printable(pair.first));
+    }
+
+    const auto sortedLines = sortedByCount(lineSamples).mid(0, TopCount);
+    if (!sortedLines.isEmpty()) {
+        std::fprintf(stderr, "  self%%  line\n");
+    }
+    for (const auto &pair : sortedLines) {
+        const QString &file = pair.first.first;
+        const int line = pair.first.second;
+        if (file == "<stdin>") {
+            std::fprintf(stderr, " %6.1f  %5d| %s\n", pair.second * 100 / samples, line, qUtf8Printable(lines.value(line - 1).trimmed()));
+        } else {
+            std::fprintf(stderr, " %6.1f  %s:%d\n", pair.second * 100 / samples, qUtf8Printable(file), line);
+        }
+    }
+    std::fflush(stderr);
+}
+
+
+// "main;f;g 12" lines for flame graphs
+bool Profiler::writeFoldedStacks(const QString &path)
+{
+    if (_fd < 0) {
+        return false;
+    }
+    symbolize();
+
+    QMap<QString, quint64> folded;
+    for (const auto &entry : _stacks) {
+        QStringList functions;
+        for (size_t i = entry.first.size(); i-- > 0;) {
+            functions << symbol(entry.first, i).function;
+        }
+        folded[functions.join(';')] += entry.second;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::fprintf(stderr, ">>> failed to write %s\n", qUtf8Printable(path));
+        return false;
+    }
+    for (auto it = folded.cbegin(); it != folded.cend(); ++it) {
+        file.write((it.key() + " " + QString::number(it.value()) + "\n").toUtf8());
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "symbolizer.h"
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include <map>
+#include <sys/types.h>
+#include <vector>
+
+
+// Sampling profiler of the executed program by perf_event_open (Linux);
+// reports the functions and the source lines the time is spent in
+class Profiler {
+public:
+    Profiler();
+    ~Profiler();
+
+    bool prepare();
+    std::function<void()> childProcessModifier() const;
+    void attach(pid_t pid);
+    void read();
+    void printReport(const QStringList &lines);
+    bool writeFoldedStacks(const QString &path);
+
+    static QStringList compileOptions();
+
+private:
+    void symbolize();
+    const Symbolizer::Symbol &symbol(const std::vector<quint64> &stack, size_t frame) const;
+
+    int _pipe[2] {-1, -1};  // holds the child until the counter is attached
+    int _fd {-1};
+    void *_buffer {nullptr};  // ring buffer mapped
+    size_t _bufferSize {0};
+    int _frequency {999};
+    std::map<std::vector<quint64>, quint64> _stacks;  // call chains from the leaf, and samples
+    quint64 _samples {0};
+    quint64 _lost {0};
+    Symbolizer _symbolizer;
+    bool _symbolized {false};
+};
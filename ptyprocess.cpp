@@ -4,6 +4,7 @@
 #include <QDebug>
 #include <iostream>
 #include "global.h"
+#include "tracer.h"
 #ifdef Q_OS_MACOS
 #include <util.h>
 #else
@@ -12,10 +13,13 @@
 #include <unistd.h>     // read, execvp, close, _exit
 #include <fcntl.h>      // fcntl
 #include <sys/wait.h>   // waitpid
+#include <sys/resource.h>  // wait4, rusage
 #include <poll.h>
 #include <signal.h>
 #include <errno.h>
 
+extern char **environ;
+
 
 PtyProcess::~PtyProcess()
 {
@@ -24,6 +28,11 @@ PtyProcess::~PtyProcess()
         delete _notifier;
     }
 
+    if (_writeNotifier) {
+        _writeNotifier->setEnabled(false);
+        delete _writeNotifier;
+    }
+
     if (_fd >= 0) {
         ::close(_fd);
     }
@@ -37,16 +46,35 @@ PtyProcess::~PtyProcess()
 
 bool PtyProcess::start(const QString &program, const QStringList &arguments)
 {
+    TraceSpan span("PtyProcess::start");
+
     if (_pid > 0) {
         qWarning() << "process already started";
         return false;
     }
 
+    // keeps the original stdin (file or pipe) to hand it to the child
+    int inputFd = _passThroughStdin ? ::dup(STDIN_FILENO) : -1;
+
+    // prepared before fork, not to allocate in the child
+    std::vector<QByteArray> envBytes;
+    std::vector<char *> envp;
+    for (const QString &var : _environment) {
+        envBytes.push_back(var.toLocal8Bit());
+    }
+    for (QByteArray &var : envBytes) {
+        envp.push_back(var.data());
+    }
+    envp.push_back(nullptr);
+
     int masterFd = -1;
     pid_t pid = ::forkpty(&masterFd, nullptr, nullptr, nullptr);
 
     if (pid < 0) {
         qWarning() << "forkpty failed:" << strerror(errno);
+        if (inputFd >= 0) {
+            ::close(inputFd);
+        }
         return false;
     }
 
@@ -55,6 +83,20 @@ bool PtyProcess::start(const QString &program, const QStringList &arguments)
         // stdin/stdout/stderr -> slave PTY
         ::dup2(STDOUT_FILENO, STDERR_FILENO);
 
+        if (inputFd >= 0) {
+            // stdin -> original stdin
+            ::dup2(inputFd, STDIN_FILENO);
+            ::close(inputFd);
+        }
+
+        if (_childModifier) {
+            _childModifier();
+        }
+
+        if (!_environment.isEmpty()) {
+            environ = envp.data();
+        }
+
         QByteArray prog = program.toLocal8Bit();
         std::vector<QByteArray> argBytes;
         argBytes.reserve(arguments.size());
@@ -79,6 +121,10 @@ bool PtyProcess::start(const QString &program, const QStringList &arguments)
         return false;
     }
 
+    if (inputFd >= 0) {
+        ::close(inputFd);
+    }
+
     _pid = pid;
     _fd = masterFd;
     _state = QProcess::Running;
@@ -91,6 +137,10 @@ bool PtyProcess::start(const QString &program, const QStringList &arguments)
 
     _notifier = new QSocketNotifier(_fd, QSocketNotifier::Read, this);
     connect(_notifier, &QSocketNotifier::activated, this, &PtyProcess::readAvailable);
+
+    _writeNotifier = new QSocketNotifier(_fd, QSocketNotifier::Write, this);
+    _writeNotifier->setEnabled(false);  // enabled while data is pending
+    connect(_writeNotifier, &QSocketNotifier::activated, this, &PtyProcess::writeAvailable);
     return true;
 }
 
@@ -125,13 +175,17 @@ bool PtyProcess::waitForFinished(int msecs)
 
         struct pollfd pfd {
             .fd = _fd,
-            .events = POLL_IN | POLL_HUP | POLL_ERR,
+            .events = short(POLL_IN | POLL_HUP | POLL_ERR | (_writeBuffer.isEmpty() ? 0 : POLLOUT)),
             .revents = 0
         };
 
         int r = epoll(&pfd, 1, timeout);
 
         if (r > 0) {
+            if (pfd.revents & POLLOUT) {
+                writeToPty();
+            }
+
             if (pfd.revents & (POLL_IN | POLL_HUP | POLL_ERR)) {
                 readFromPty();
             }
@@ -153,6 +207,22 @@ bool PtyProcess::waitForFinished(int msecs)
 }
 
 
+// Terminates the process group of the child, forcibly if it does not exit in time
+void PtyProcess::kill()
+{
+    if (_pid <= 0) {
+        return;
+    }
+
+    // the child is a session leader of forkpty
+    ::kill(-_pid, SIGTERM);
+    if (!waitForFinished(500)) {
+        ::kill(-_pid, SIGKILL);
+        waitForFinished(-1);
+    }
+}
+
+
 void PtyProcess::readFromPty()
 {
     if (_fd < 0) {
@@ -198,7 +268,8 @@ bool PtyProcess::checkFinished()
     }
 
     int status = 0;
-    pid_t r = ::waitpid(_pid, &status, WNOHANG);
+    struct rusage ru {};
+    pid_t r = ::wait4(_pid, &status, WNOHANG, &ru);
 
     if (r == 0) {
         return false;
@@ -213,6 +284,19 @@ bool PtyProcess::checkFinished()
         return true;
     }
 
+    _usage.valid = true;
+    _usage.userTime = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0;
+    _usage.systemTime = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+#ifdef Q_OS_DARWIN
+    _usage.maxRss = ru.ru_maxrss / 1024;  // bytes on macOS
+#else
+    _usage.maxRss = ru.ru_maxrss;  // kilobytes
+#endif
+    _usage.minorFaults = ru.ru_minflt;
+    _usage.majorFaults = ru.ru_majflt;
+    _usage.voluntaryContextSwitches = ru.ru_nvcsw;
+    _usage.involuntaryContextSwitches = ru.ru_nivcsw;
+
     int exitCode = -1;
 
     if (WIFEXITED(status)) {
@@ -232,28 +316,48 @@ qint64 PtyProcess::write(const QByteArray &data)
         return -1;
     }
 
-    const char *p = data.constData();
+    // queues the data; it is written as the PTY becomes writable
+    _writeBuffer.append(data);
+    writeToPty();
+    return data.size();
+}
+
+
+void PtyProcess::writeToPty()
+{
+    if (_fd < 0) {
+        return;
+    }
+
     qint64 total = 0;
-    qint64 remaining = data.size();
 
-    while (remaining > 0) {
-        ssize_t n = ewrite(_fd, p + total, size_t(remaining));
+    while (total < _writeBuffer.size()) {
+        ssize_t n = ewrite(_fd, _writeBuffer.constData() + total, size_t(_writeBuffer.size() - total));
 
         if (n > 0) {
             total += n;
-            remaining -= n;
             continue;
         }
 
         if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-            // non-blocking fd なので、ここで一旦返す
-            return total;
+            // non-blocking fd, waits for write-readiness
+            break;
         }
 
-        return total > 0 ? total : -1;
+        qWarning() << "write failed:" << strerror(errno);
+        total = _writeBuffer.size();  // discards the rest
+        break;
     }
 
-    return total;
+    _writeBuffer.remove(0, total);
+
+    if (_writeNotifier) {
+        _writeNotifier->setEnabled(!_writeBuffer.isEmpty());
+    }
+
+    if (total > 0) {
+        emit bytesWritten(total);
+    }
 }
 
 
@@ -269,6 +373,14 @@ void PtyProcess::finishProcess(int exitCode)
         _notifier = nullptr;
     }
 
+    if (_writeNotifier) {
+        _writeNotifier->setEnabled(false);
+        _writeNotifier->deleteLater();
+        _writeNotifier = nullptr;
+    }
+
+    _writeBuffer.clear();
+
     if (_fd >= 0) {
         ::close(_fd);
         _fd = -1;
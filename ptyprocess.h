@@ -3,6 +3,8 @@
 #include <QByteArray>
 #include <QStringList>
 #include <QProcess>
+#include <functional>
+#include "resourceusage.h"
 
 class QSocketNotifier;
 
@@ -17,11 +19,17 @@ public:
 
     ~PtyProcess() override;
     bool start(const QString &program, const QStringList &arguments);
+    void setStandardInputPassThrough(bool enable) { _passThroughStdin = enable; }
+    void setChildProcessModifier(const std::function<void()> &modifier) { _childModifier = modifier; }
+    void setEnvironment(const QStringList &environment) { _environment = environment; }
     qint64 write(const QByteArray &data);
+    qint64 bytesToWrite() const { return _writeBuffer.size(); }
     pid_t pid() const { return _pid; }
     void closeWriteChannel() { }
     bool waitForFinished(int msecs = 30000);
+    void kill();
     QProcess::ProcessState state() const { return _state; }
+    const ResourceUsage &resourceUsage() const { return _usage; }
     QByteArray readAll()
     {
         QByteArray result;
@@ -31,6 +39,7 @@ public:
 
 signals:
     void readyRead();
+    void bytesWritten(qint64 bytes);
     void finished(int exitCode);
 
 private slots:
@@ -40,8 +49,14 @@ private slots:
         checkFinished();
     }
 
+    void writeAvailable()
+    {
+        writeToPty();
+    }
+
 private:
     void readFromPty();
+    void writeToPty();
     bool checkFinished();
     void finishProcess(int exitCode);
 
@@ -49,6 +64,12 @@ private:
     pid_t _pid {-1};
     int _fd {-1};
     QSocketNotifier *_notifier {nullptr};
+    QSocketNotifier *_writeNotifier {nullptr};
     QByteArray _buffer;
+    QByteArray _writeBuffer;
+    bool _passThroughStdin {false};
+    std::function<void()> _childModifier;  // called in the child before exec
+    QStringList _environment;  // inherits the environment if empty
     QProcess::ProcessState _state {QProcess::NotRunning};
+    ResourceUsage _usage;
 };
@@ -11,6 +11,9 @@
 #include <QMetaObject>
 #include <QDebug>
 #include <windows.h>
+#include <psapi.h>
+#include "resourceusage.h"
+#include "tracer.h"
 
 
 class PtyProcess : public QObject
@@ -29,6 +32,8 @@ public:
 
     bool start(const QString &program, const QStringList &arguments = {})
     {
+        TraceSpan span("PtyProcess::start");
+
         if (_state != QProcess::NotRunning) {
             return false;
         }
@@ -215,11 +220,21 @@ public:
         return true;
     }
 
+    qint64 pid() const
+    {
+        return _process ? qint64(GetProcessId(_process)) : -1;
+    }
+
     QProcess::ProcessState state() const
     {
         return _state;
     }
 
+    const ResourceUsage &resourceUsage() const
+    {
+        return _usage;
+    }
+
     void kill()
     {
         if (_process && _state != QProcess::NotRunning) {
@@ -456,6 +471,7 @@ private:
         }
 
         if (_process) {
+            collectResourceUsage();
             CloseHandle(_process);
             _process = nullptr;
         }
@@ -464,6 +480,30 @@ private:
         emit finished(exitCode);
     }
 
+    void collectResourceUsage()
+    {
+        // FILETIME is in 100-nanosecond units
+        auto seconds = [](const FILETIME &ft) {
+            ULARGE_INTEGER v;
+            v.LowPart = ft.dwLowDateTime;
+            v.HighPart = ft.dwHighDateTime;
+            return v.QuadPart / 10000000.0;
+        };
+
+        FILETIME creation, exit, kernel, user;
+        if (GetProcessTimes(_process, &creation, &exit, &kernel, &user)) {
+            _usage.userTime = seconds(user);
+            _usage.systemTime = seconds(kernel);
+            _usage.valid = true;
+        }
+
+        PROCESS_MEMORY_COUNTERS pmc {};
+        if (GetProcessMemoryInfo(_process, &pmc, sizeof(pmc))) {
+            _usage.maxRss = qint64(pmc.PeakWorkingSetSize / 1024);
+            _usage.minorFaults = pmc.PageFaultCount;  // soft and hard faults are not distinguished
+        }
+    }
+
     void cleanup()
     {
         _running = false;
@@ -586,4 +626,5 @@ private:
     QElapsedTimer _startupFilterTimer;
     QByteArray _startupVtCarry;
     QProcess::ProcessState _state {QProcess::NotRunning};
+    ResourceUsage _usage;
 };
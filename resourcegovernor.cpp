@@ -0,0 +1,352 @@
+#include "resourcegovernor.h"
+#include "global.h"
+#include <QtCore/QtCore>
+#include <atomic>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+using namespace cpi;
+
+
+// "512M", "2G", "max"
+static bool parseSize(const QString &str, qint64 &bytes)
+{
+    static const QRegularExpression re("^(\\d+)([KMGT]?)$", QRegularExpression::CaseInsensitiveOption);
+    if (str == "max") {
+        bytes = -1;
+        return true;
+    }
+
+    auto match = re.match(str);
+    if (!match.hasMatch()) {
+        return false;
+    }
+
+    bytes = match.captured(1).toLongLong();
+    const QString units = "KMGT";
+    int shift = units.indexOf(match.captured(2).toUpper()) + 1;
+    bytes <<= (match.captured(2).isEmpty() ? 0 : shift * 10);
+    return true;
+}
+
+
+// "memory=512M cpu=50% pids=64"; cpu is a percentage of one CPU or a number of CPUs
+bool ResourceLimits::parse(const QString &spec)
+{
+    for (const auto &item : spec.split(QRegularExpression("[\\s,]+"), SkipEmptyParts)) {
+        QString key = item.section('=', 0, 0).trimmed().toLower();
+        QString value = item.section('=', 1).trimmed();
+        bool ok = false;
+
+        if (key == "memory" || key == "mem") {
+            ok = parseSize(value, memoryMax);
+        } else if (key == "cpu") {
+            if (value == "max") {
+                cpuQuota = -1;
+                ok = true;
+            } else if (value.endsWith('%')) {
+                double percent = value.chopped(1).toDouble(&ok);
+                cpuQuota = qint64(cpuPeriod * percent / 100);
+            } else {
+                double cpus = value.toDouble(&ok);
+                cpuQuota = qint64(cpuPeriod * cpus);
+            }
+            ok = ok && (cpuQuota < 0 || cpuQuota >= 1000);  // the kernel's minimum
+        } else if (key == "pids") {
+            pidsMax = (value == "max") ? -1 : value.toLongLong(&ok);
+            ok = ok || value == "max";
+        }
+
+        if (!ok) {
+            std::fprintf(stderr, "Invalid resource limit: %s\n", qUtf8Printable(item));
+            return false;
+        }
+    }
+    return true;
+}
+
+
+QString ResourceLimits::toString() const
+{
+    QStringList list;
+    if (memoryMax >= 0) {
+        list << QString("memory %1M").arg(memoryMax / (1024 * 1024));
+    }
+    if (cpuQuota >= 0) {
+        list << QString("cpu %1%").arg(cpuQuota * 100 / cpuPeriod);
+    }
+    if (pidsMax >= 0) {
+        list << QString("pids %1").arg(pidsMax);
+    }
+    return list.join(", ");
+}
+
+
+ResourceLimits ResourceLimits::fromConfig()
+{
+    ResourceLimits limits;
+    QStringList spec;
+    const QList<QPair<QString, QString>> keys = {{"MEMORY_MAX", "memory"}, {"CPU_MAX", "cpu"}, {"PIDS_MAX", "pids"}};
+
+    for (const auto &key : keys) {
+        QString value = conf->value(key.first).toString().trimmed();
+        if (!value.isEmpty()) {
+            spec << key.second + "=" + value;
+        }
+    }
+    limits.parse(spec.join(" "));
+    return limits;
+}
+
+
+static QByteArray readFile(const QString &path)
+{
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) ? file.readAll().trimmed() : QByteArray();
+}
+
+
+static bool writeFile(const QString &path, const QByteArray &data)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+        return false;
+    }
+    return file.write(data) == data.size();
+}
+
+
+// "key value" lines of cpu.stat and memory.events
+static qint64 statValue(const QByteArray &stat, const QByteArray &key)
+{
+    for (const auto &line : stat.split('\n')) {
+        auto fields = line.split(' ');
+        if (fields.value(0) == key) {
+            return fields.value(1).toLongLong();
+        }
+    }
+    return -1;
+}
+
+
+// Governors holding cgroups; read by the signal handler
+static std::atomic_int activeGovernors {0};
+
+
+ResourceGovernor::ResourceGovernor(const ResourceLimits &limits) :
+    _limits(limits)
+{
+}
+
+
+ResourceGovernor::~ResourceGovernor()
+{
+    if (!_cgroup.isEmpty() || !_leaf.isEmpty()) {
+        release();
+        activeGovernors--;
+    }
+}
+
+
+// True while cgroups are to be removed; the signal handler then lets the
+// program be killed and the governor be destroyed instead of exiting
+bool ResourceGovernor::isActive()
+{
+    return activeGovernors > 0;
+}
+
+
+// Removes the cgroups
+void ResourceGovernor::release()
+{
+    if (!_cgroup.isEmpty()) {
+        // may be busy for a moment after the process is reaped, or by the
+        // processes the program left behind
+        for (int i = 0; i < 20 && !QDir().rmdir(_cgroup); i++) {
+            if (i == 0) {
+                writeFile(_cgroup + "/cgroup.kill", "1");
+            }
+            Sleep(10);
+        }
+    }
+
+    if (!_leaf.isEmpty()) {
+        // moves cpi back to its own cgroup, which can have processes again
+        // without the controllers enabled for the children
+        QStringList control;
+        for (const auto &c : _controllers) {
+            control << "-" + c;
+        }
+        if (!control.isEmpty()) {
+            writeFile(_root + "/cgroup.subtree_control", control.join(' ').toLatin1());
+        }
+        if (writeFile(_root + "/cgroup.procs", QByteArray::number(getpid()))) {
+            QDir().rmdir(_leaf);
+        }
+    }
+}
+
+
+// Enabled controllers are appended to the list if given
+bool ResourceGovernor::enableControllers(const QString &root, QStringList *added) const
+{
+    QStringList needed;
+    if (_limits.memoryMax >= 0) {
+        needed << "memory";
+    }
+    if (_limits.cpuQuota >= 0) {
+        needed << "cpu";
+    }
+    if (_limits.pidsMax >= 0) {
+        needed << "pids";
+    }
+
+    const QStringList enabled = QString::fromLatin1(readFile(root + "/cgroup.subtree_control")).split(' ', SkipEmptyParts);
+    QStringList control;
+    for (const auto &c : needed) {
+        if (!enabled.contains(c)) {
+            control << "+" + c;
+        }
+    }
+    if (control.isEmpty()) {
+        return true;
+    }
+    if (!writeFile(root + "/cgroup.subtree_control", control.join(' ').toLatin1())) {
+        return false;
+    }
+    if (added) {
+        for (const auto &c : control) {
+            *added << c.mid(1);
+        }
+    }
+    return true;
+}
+
+
+bool ResourceGovernor::prepare()
+{
+    if (_limits.isEmpty()) {
+        return false;
+    }
+
+#ifdef Q_OS_LINUX
+    // own cgroup, "0::/user.slice/..."
+    QString own;
+    for (const auto &line : readFile("/proc/self/cgroup").split('\n')) {
+        if (line.startsWith("0::")) {
+            own = "/sys/fs/cgroup" + QString::fromLocal8Bit(line.mid(3));
+        }
+    }
+
+    QString root = conf->value("CGROUP_ROOT").toString().trimmed();
+    if (root.isEmpty()) {
+        root = own;  // delegated, e.g. by systemd-run --user --scope -p Delegate=yes
+    }
+
+    // counted before the cgroups are made, as the signal handler reads it
+    activeGovernors++;
+    if (!root.isEmpty() && QFileInfo(root + "/cgroup.subtree_control").isWritable()) {
+        if (!enableControllers(root) && root == own) {
+            // controllers can not be distributed from a cgroup with processes,
+            // so moves cpi itself into a leaf until the governor is destroyed
+            QString leaf = root + "/cpi.supervisor";
+            QDir().mkpath(leaf);
+            if (writeFile(leaf + "/cgroup.procs", QByteArray::number(getpid()))) {
+                _root = root;
+                _leaf = leaf;
+                enableControllers(root, &_controllers);
+            }
+        }
+
+        static int counter = 0;
+        QString path = root + QString("/cpi-%1-%2").arg(getpid()).arg(counter++);
+        if (QDir().mkdir(path)) {
+            bool ok = true;
+            if (_limits.memoryMax >= 0) {
+                ok = ok && writeFile(path + "/memory.max", QByteArray::number(_limits.memoryMax));
+                writeFile(path + "/memory.swap.max", "0");  // no swapping instead of the OOM killer
+            }
+            if (_limits.cpuQuota >= 0) {
+                ok = ok && writeFile(path + "/cpu.max", QByteArray::number(_limits.cpuQuota) + " " + QByteArray::number(_limits.cpuPeriod));
+            }
+            if (_limits.pidsMax >= 0) {
+                ok = ok && writeFile(path + "/pids.max", QByteArray::number(_limits.pidsMax));
+            }
+
+            if (ok) {
+                _cgroup = path;
+                return true;
+            }
+            QDir().rmdir(path);
+        }
+    }
+    if (_leaf.isEmpty()) {
+        activeGovernors--;
+    }
+#endif
+
+    static bool warned = false;
+    if (!warned) {
+        std::fprintf(stderr, ">>> cgroup v2 not available, limits only the address space by setrlimit\n");
+        warned = true;
+    }
+    _rlimit = true;
+    return _limits.memoryMax >= 0;
+}
+
+
+// Runs in the child process between fork and exec
+std::function<void()> ResourceGovernor::childProcessModifier() const
+{
+    if (!_cgroup.isEmpty()) {
+        QByteArray procs = (_cgroup + "/cgroup.procs").toLocal8Bit();
+        return [procs]() {
+            int fd = ::open(procs.constData(), O_WRONLY | O_CLOEXEC);
+            if (fd >= 0) {
+                (void)!::write(fd, "0", 1);  // moves itself
+                ::close(fd);
+            }
+        };
+    }
+
+    if (_rlimit && _limits.memoryMax >= 0) {
+        rlim_t bytes = _limits.memoryMax;
+        return [bytes]() {
+            struct rlimit rl {bytes, bytes};
+            ::setrlimit(RLIMIT_AS, &rl);
+        };
+    }
+    return std::function<void()>();
+}
+
+
+void ResourceGovernor::printReport() const
+{
+    if (_cgroup.isEmpty()) {
+        return;
+    }
+
+    const QByteArray cpuStat = readFile(_cgroup + "/cpu.stat");
+    const QByteArray memoryEvents = readFile(_cgroup + "/memory.events");
+    const QByteArray memoryPeak = readFile(_cgroup + "/memory.peak");
+    const QByteArray pidsPeak = readFile(_cgroup + "/pids.peak");
+
+    // Prints to stderr not to mix with the output of the program
+    std::fprintf(stderr, ">>> cgroup usage (%s)\n", qUtf8Printable(_limits.toString()));
+    if (!memoryPeak.isEmpty()) {
+        std::fprintf(stderr, " memory peak           %lld KB\n", memoryPeak.toLongLong() / 1024);
+    }
+    std::fprintf(stderr, " CPU usage             %.3f s (user %.3f s, system %.3f s)\n",
+        statValue(cpuStat, "usage_usec") / 1e6, statValue(cpuStat, "user_usec") / 1e6, statValue(cpuStat, "system_usec") / 1e6);
+    if (statValue(cpuStat, "nr_throttled") >= 0) {
+        std::fprintf(stderr, " throttled             %lld times, %.3f s\n", statValue(cpuStat, "nr_throttled"), statValue(cpuStat, "throttled_usec") / 1e6);
+    }
+    if (!pidsPeak.isEmpty()) {
+        std::fprintf(stderr, " pids peak             %lld\n", pidsPeak.toLongLong());
+    }
+    if (statValue(memoryEvents, "oom_kill") > 0) {
+        std::fprintf(stderr, " OOM kills             %lld\n", statValue(memoryEvents, "oom_kill"));
+    }
+    std::fflush(stderr);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+
+// Limits of the resources for the executed program
+struct ResourceLimits {
+    qint64 memoryMax {-1};  // bytes
+    qint64 cpuQuota {-1};  // usecs per period
+    qint64 cpuPeriod {100000};  // usecs
+    qint64 pidsMax {-1};
+
+    bool isEmpty() const { return memoryMax < 0 && cpuQuota < 0 && pidsMax < 0; }
+    bool parse(const QString &spec);
+    QString toString() const;
+    static ResourceLimits fromConfig();
+};
+
+
+// Places the executed program in a transient cgroup v2 with the limits,
+// or limits its address space by setrlimit if cgroups are not available
+class ResourceGovernor {
+public:
+    explicit ResourceGovernor(const ResourceLimits &limits);
+    ~ResourceGovernor();
+
+    bool prepare();
+    std::function<void()> childProcessModifier() const;
+    void printReport() const;
+    static bool isActive();
+
+private:
+    void release();
+    bool enableControllers(const QString &root, QStringList *added = nullptr) const;
+
+    ResourceLimits _limits;
+    QString _cgroup;  // path of the cgroup, empty if not used
+    QString _root;  // own cgroup of cpi, moved out of it to the leaf
+    QString _leaf;  // cgroup cpi was moved to, empty if not moved
+    QStringList _controllers;  // enabled in the own cgroup after the move
+    bool _rlimit {false};
+};
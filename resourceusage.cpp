@@ -0,0 +1,22 @@
+#include "resourceusage.h"
+#include <cstdio>
+
+
+void printResourceUsage(const ResourceUsage &usage)
+{
+    if (!usage.valid) {
+        std::fprintf(stderr, ">>> Resource usage not available\n");
+        return;
+    }
+
+    // Prints to stderr not to mix with the output of the program
+    std::fprintf(stderr, ">>> Resource usage\n");
+    std::fprintf(stderr, " user CPU time         %.3f s\n", usage.userTime);
+    std::fprintf(stderr, " system CPU time       %.3f s\n", usage.systemTime);
+    std::fprintf(stderr, " max RSS               %lld KB\n", (long long)usage.maxRss);
+    std::fprintf(stderr, " minor page faults     %lld\n", (long long)usage.minorFaults);
+    std::fprintf(stderr, " major page faults     %lld\n", (long long)usage.majorFaults);
+    std::fprintf(stderr, " voluntary ctx sw      %lld\n", (long long)usage.voluntaryContextSwitches);
+    std::fprintf(stderr, " involuntary ctx sw    %lld\n", (long long)usage.involuntaryContextSwitches);
+    std::fflush(stderr);
+}
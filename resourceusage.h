@@ -0,0 +1,18 @@
+#pragma once
+#include <QtGlobal>
+
+
+// Resource usage of a finished child process
+struct ResourceUsage {
+    bool valid {false};
+    double userTime {0};  // seconds
+    double systemTime {0};  // seconds
+    qint64 maxRss {0};  // kilobytes
+    qint64 minorFaults {0};
+    qint64 majorFaults {0};
+    qint64 voluntaryContextSwitches {0};
+    qint64 involuntaryContextSwitches {0};
+};
+
+
+extern void printResourceUsage(const ResourceUsage &usage);
@@ -0,0 +1,384 @@
+// Fast text input and output for cpi scripts
+//
+//   #include <cpi/fastio.h>
+//
+//   cpi::FileView in = cpi::FileView::standardInput();  // or cpi::FileView("data.csv")
+//   long long sum = 0;
+//   for (std::string_view line : cpi::lines(in.view())) {
+//       for (std::string_view field : cpi::fields(line, ',')) {
+//           sum += cpi::to<long long>(field);
+//       }
+//   }
+//
+// Defining CPI_FAST_STDIO (the "FastIO: true" directive) unties std::cin
+// from std::cout, stops syncing with stdio and enlarges the output buffer.
+// Requires C++17 (-std=c++17 or later).
+#pragma once
+#if defined(_MSVC_LANG) ? _MSVC_LANG < 201703L : __cplusplus < 201703L
+#error "cpi/fastio.h requires C++17"
+#endif
+#include <charconv>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#if defined(_WIN32)
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace cpi {
+
+// Read-only view of a whole file, mapped into memory if possible
+class FileView {
+public:
+    FileView() = default;
+
+    explicit FileView(const char *path)
+    {
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        LARGE_INTEGER size;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) {
+                _data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                _size = _data ? std::size_t(size.QuadPart) : 0;
+                _mapped = _data != nullptr;
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd >= 0) {
+            map(fd);
+            ::close(fd);
+        }
+#endif
+    }
+
+    explicit FileView(const std::string &path) :
+        FileView(path.c_str())
+    {}
+
+    // Standard input, mapped if it is redirected from a file
+    static FileView standardInput()
+    {
+        FileView view;
+#if !defined(_WIN32)
+        if (view.map(STDIN_FILENO)) {
+            return view;
+        }
+#endif
+        char buf[1 << 16];
+        std::size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), stdin)) > 0) {
+            view._buffer.append(buf, n);
+        }
+        view._data = view._buffer.data();
+        view._size = view._buffer.size();
+        return view;
+    }
+
+    FileView(const FileView &) = delete;
+    FileView &operator=(const FileView &) = delete;
+
+    FileView(FileView &&other) noexcept { *this = std::move(other); }
+
+    FileView &operator=(FileView &&other) noexcept
+    {
+        if (this != &other) {
+            release();
+            _buffer = std::move(other._buffer);
+            _data = other._data ? (other._mapped ? other._data : _buffer.data()) : nullptr;
+            _size = other._size;
+            _mapped = other._mapped;
+            other._data = nullptr;
+            other._size = 0;
+            other._mapped = false;
+        }
+        return *this;
+    }
+
+    ~FileView() { release(); }
+
+    bool isOpen() const { return _data != nullptr; }
+    const char *data() const { return _data; }
+    std::size_t size() const { return _size; }
+    std::string_view view() const { return std::string_view(_data ? _data : "", _size); }
+
+private:
+#if !defined(_WIN32)
+    bool map(int fd)
+    {
+        struct stat st;
+        if (::fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+            return false;
+        }
+        void *addr = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+        ::madvise(addr, std::size_t(st.st_size), MADV_SEQUENTIAL);
+        _data = static_cast<const char *>(addr);
+        _size = std::size_t(st.st_size);
+        _mapped = true;
+        return true;
+    }
+#endif
+
+    void release()
+    {
+        if (_mapped) {
+#if defined(_WIN32)
+            UnmapViewOfFile(_data);
+#else
+            ::munmap(const_cast<char *>(_data), _size);
+#endif
+        }
+        _data = nullptr;
+        _size = 0;
+        _mapped = false;
+    }
+
+    const char *_data {nullptr};
+    std::size_t _size {0};
+    bool _mapped {false};
+    std::string _buffer;  // standard input not mapped
+};
+
+
+// Finds the first c in [first, last), or last; memchr is vectorized by libc
+inline const char *find(const char *first, const char *last, char c)
+{
+    const void *p = std::memchr(first, c, std::size_t(last - first));
+    return p ? static_cast<const char *>(p) : last;
+}
+
+
+// Finds the first c1 or c2 in [first, last), or last
+inline const char *findAny(const char *first, const char *last, char c1, char c2)
+{
+#if defined(__AVX2__)
+    const __m256i v1 = _mm256_set1_epi8(c1);
+    const __m256i v2 = _mm256_set1_epi8(c2);
+    for (; last - first >= 32; first += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+        unsigned mask = unsigned(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, v1), _mm256_cmpeq_epi8(chunk, v2))));
+        if (mask) {
+            return first + __builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128i v1 = _mm_set1_epi8(c1);
+    const __m128i v2 = _mm_set1_epi8(c2);
+    for (; last - first >= 16; first += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+        unsigned mask = unsigned(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, v1), _mm_cmpeq_epi8(chunk, v2))));
+        if (mask) {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return first + index;
+#else
+            return first + __builtin_ctz(mask);
+#endif
+        }
+    }
+#endif
+    for (; first != last; ++first) {
+        if (*first == c1 || *first == c2) {
+            break;
+        }
+    }
+    return first;
+}
+
+
+// Range of the pieces of a text separated by a delimiter, without copying
+class Splitter {
+public:
+    Splitter(std::string_view text, char delimiter, bool skipLastEmpty, bool stripCR = false) :
+        _text(text), _delimiter(delimiter), _skipLastEmpty(skipLastEmpty), _stripCR(stripCR)
+    {}
+
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string_view *;
+        using reference = std::string_view;
+
+        iterator() = default;
+        iterator(const char *first, const char *last, char delimiter, bool skipLastEmpty, bool stripCR) :
+            _pos(first), _last(last), _delimiter(delimiter), _skipLastEmpty(skipLastEmpty), _stripCR(stripCR), _atEnd(false)
+        {
+            next();
+        }
+
+        std::string_view operator*() const { return _piece; }
+        iterator &operator++()
+        {
+            next();
+            return *this;
+        }
+        void operator++(int) { next(); }
+        bool operator==(const iterator &other) const { return _atEnd == other._atEnd && (_atEnd || _pos == other._pos); }
+        bool operator!=(const iterator &other) const { return !(*this == other); }
+
+    private:
+        void next()
+        {
+            if (!_pos || (_pos == _last && _skipLastEmpty)) {
+                _atEnd = true;
+                return;
+            }
+            const char *found = cpi::find(_pos, _last, _delimiter);
+            _piece = std::string_view(_pos, std::size_t(found - _pos));
+            if (_stripCR && !_piece.empty() && _piece.back() == '\r') {
+                _piece.remove_suffix(1);
+            }
+            _pos = (found == _last) ? nullptr : found + 1;  // nullptr after the last piece
+        }
+
+        const char *_pos {nullptr};
+        const char *_last {nullptr};
+        char _delimiter {'\n'};
+        bool _skipLastEmpty {false};
+        bool _stripCR {false};
+        bool _atEnd {true};
+        std::string_view _piece;
+    };
+
+    iterator begin() const
+    {
+        const char *first = _text.data() ? _text.data() : "";
+        return iterator(first, first + _text.size(), _delimiter, _skipLastEmpty, _stripCR);
+    }
+    iterator end() const { return iterator(); }
+
+private:
+    std::string_view _text;
+    char _delimiter;
+    bool _skipLastEmpty;
+    bool _stripCR;
+};
+
+
+// Lines of a text without the line breaks ("\n" or "\r\n")
+inline Splitter lines(std::string_view text)
+{
+    return Splitter(text, '\n', true, true);
+}
+
+
+// Fields of a line separated by the delimiter
+inline Splitter fields(std::string_view line, char delimiter = ',')
+{
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    return Splitter(line, delimiter, false);
+}
+
+
+// Splits into the vector, reusing its capacity
+inline void split(std::string_view line, char delimiter, std::vector<std::string_view> &out)
+{
+    out.clear();
+    for (auto field : fields(line, delimiter)) {
+        out.push_back(field);
+    }
+}
+
+
+// Calls f(field, endOfLine) for each field of the text in one pass
+template <typename F>
+inline void forEachField(std::string_view text, char delimiter, F &&f)
+{
+    const char *pos = text.data();
+    const char *last = pos + text.size();
+    while (pos != last) {
+        const char *found = findAny(pos, last, delimiter, '\n');
+        std::string_view field(pos, std::size_t(found - pos));
+        const bool endOfLine = (found == last || *found == '\n');
+        if (endOfLine && !field.empty() && field.back() == '\r') {
+            field.remove_suffix(1);
+        }
+        f(field, endOfLine);
+        pos = (found == last) ? last : found + 1;
+    }
+}
+
+
+// Parses a number by std::from_chars; leading spaces and a '+' are allowed
+template <typename T>
+inline bool parse(std::string_view text, T &value)
+{
+    const char *first = text.data();
+    const char *last = first + text.size();
+    while (first != last && (*first == ' ' || *first == '\t')) {
+        ++first;
+    }
+    if (first != last && *first == '+') {
+        ++first;
+        if (first != last && *first == '-') {
+            return false;
+        }
+    }
+    auto [ptr, ec] = std::from_chars(first, last, value);
+    return ec == std::errc() && ptr != first;
+}
+
+
+template <typename T>
+inline T to(std::string_view text, T defaultValue = T())
+{
+    T value;
+    return parse(text, value) ? value : defaultValue;
+}
+
+}  // namespace cpi
+
+
+#ifdef CPI_FAST_STDIO
+namespace cpi {
+namespace detail {
+
+struct FastStdio {
+    FastStdio()
+    {
+        static char buffer[1 << 20];
+        std::ios::sync_with_stdio(false);
+        std::cin.tie(nullptr);
+        std::cout.rdbuf()->pubsetbuf(buffer, sizeof(buffer));
+        std::setvbuf(stdout, nullptr, _IOFBF, 1 << 20);
+    }
+};
+
+inline FastStdio fastStdio;
+
+}  // namespace detail
+}  // namespace cpi
+#endif
@@ -0,0 +1,322 @@
+// Heap profiler preloaded into the program by cpi --heap-profile (Linux, glibc)
+//
+// Counts the allocations and the bytes of malloc and its family, which
+// operator new and delete of libstdc++ and libc++ call, and tracks the live
+// and the peak heap. The call sites are taken by backtraces of one in
+// CPI_HEAP_SAMPLE allocations at random, the unwinding being the costly part.
+// The summary is written at exit to the file of CPI_HEAP_PROFILE, which cpi
+// symbolizes.
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+namespace {
+
+constexpr int MaxFrames = 16;  // of a call site
+constexpr int SkippedFrames = 2;  // record() and the allocation function
+constexpr size_t SiteSlots = 1 << 14;
+
+struct Site {
+    uint64_t hash;
+    void *frames[MaxFrames];
+    int depth;
+    uint64_t count;
+    uint64_t bytes;
+};
+
+// no allocation in the hooks; the table is static and the lock spins
+Site sites[SiteSlots];
+uint64_t lostSites = 0;  // not recorded, the table being full
+std::atomic_flag lock = ATOMIC_FLAG_INIT;
+std::atomic<uint64_t> allocations {0};
+std::atomic<uint64_t> frees {0};
+std::atomic<uint64_t> allocatedBytes {0};
+std::atomic<int64_t> liveBytes {0};  // negative by the blocks allocated before enabled
+std::atomic<int64_t> peakBytes {0};
+uint64_t samplePeriod = 1;
+pid_t ownerPid = 0;  // a forked child does not write the summary
+char outputPath[4096];  // empty in the programs the program runs
+bool enabled = false;
+
+// set while in a hook; backtrace() allocates on the first call
+__attribute__((tls_model("initial-exec"))) thread_local bool inHook = false;
+__attribute__((tls_model("initial-exec"))) thread_local uint64_t randomState = 0;
+
+
+class Guard {
+public:
+    Guard()
+    {
+        while (lock.test_and_set(std::memory_order_acquire)) { }
+    }
+    ~Guard() { lock.clear(std::memory_order_release); }
+};
+
+
+uint64_t hashFrames(void *const *frames, int depth)
+{
+    uint64_t hash = 14695981039346656037ULL;  // FNV-1a
+    for (int i = 0; i < depth; i++) {
+        hash = (hash ^ reinterpret_cast<uintptr_t>(frames[i])) * 1099511628211ULL;
+    }
+    return hash | 1;  // 0 marks an empty slot
+}
+
+
+bool isSampled()
+{
+    if (samplePeriod <= 1) {
+        return true;
+    }
+    if (randomState == 0) {
+        randomState = reinterpret_cast<uintptr_t>(&randomState) | 1;  // for each thread
+    }
+    randomState ^= randomState << 13;  // xorshift64
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState % samplePeriod == 0;
+}
+
+
+__attribute__((noinline)) void record(void *ptr, size_t size)
+{
+    if (!ptr || !enabled || inHook) {
+        return;
+    }
+
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    const int64_t live = liveBytes.fetch_add(malloc_usable_size(ptr), std::memory_order_relaxed) + malloc_usable_size(ptr);
+    int64_t peak = peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) { }
+
+    if (!isSampled()) {
+        return;
+    }
+    inHook = true;
+
+    void *frames[MaxFrames + SkippedFrames];
+    int depth = backtrace(frames, MaxFrames + SkippedFrames) - SkippedFrames;
+    depth = (depth > 0) ? depth : 0;
+    const uint64_t hash = hashFrames(frames + SkippedFrames, depth);
+
+    {
+        Guard guard;
+        size_t slot = hash % SiteSlots;
+        for (size_t n = 0; n < SiteSlots; n++, slot = (slot + 1) % SiteSlots) {
+            Site &site = sites[slot];
+            if (site.hash == 0) {
+                site.hash = hash;
+                std::memcpy(site.frames, frames + SkippedFrames, depth * sizeof(void *));
+                site.depth = depth;
+            }
+            if (site.hash == hash) {
+                site.count++;
+                site.bytes += size;
+                break;
+            }
+            if (n + 1 == SiteSlots) {
+                lostSites++;
+            }
+        }
+    }
+    inHook = false;
+}
+
+
+void release(size_t usable)
+{
+    if (!enabled) {
+        return;
+    }
+    frees.fetch_add(1, std::memory_order_relaxed);
+    liveBytes.fetch_sub(usable, std::memory_order_relaxed);
+}
+
+
+void writeText(int fd, const char *text, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = ::write(fd, text, len);
+        if (n <= 0) {
+            return;
+        }
+        text += n;
+        len -= n;
+    }
+}
+
+
+// Totals, call sites with their return addresses, and the mappings of the
+// process to symbolize the addresses
+void writeSummary(const char *path)
+{
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return;
+    }
+
+    char line[64 + MaxFrames * 20];
+    int len = std::snprintf(line, sizeof(line), "allocations %llu\nfrees %llu\nbytes %llu\npeak %lld\nsample %llu\nlost %llu\n",
+        (unsigned long long)allocations.load(), (unsigned long long)frees.load(), (unsigned long long)allocatedBytes.load(),
+        (long long)peakBytes.load(), (unsigned long long)samplePeriod, (unsigned long long)lostSites);
+    writeText(fd, line, len);
+
+    for (const Site &site : sites) {
+        if (site.hash == 0) {
+            continue;
+        }
+        len = std::snprintf(line, sizeof(line), "site %llu %llu", (unsigned long long)site.count, (unsigned long long)site.bytes);
+        for (int i = 0; i < site.depth; i++) {
+            len += std::snprintf(line + len, sizeof(line) - len, " %llx", (unsigned long long)reinterpret_cast<uintptr_t>(site.frames[i]));
+        }
+        line[len++] = '\n';
+        writeText(fd, line, len);
+    }
+
+    writeText(fd, "maps\n", 5);
+    int maps = ::open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (maps >= 0) {
+        char buffer[4096];
+        ssize_t n;
+        while ((n = ::read(maps, buffer, sizeof(buffer))) > 0) {
+            writeText(fd, buffer, n);
+        }
+        ::close(maps);
+    }
+    ::close(fd);
+}
+
+
+__attribute__((constructor)) void start()
+{
+    // loads the unwinder before counting
+    inHook = true;
+    void *frames[1];
+    backtrace(frames, 1);
+    inHook = false;
+
+    const char *period = ::getenv("CPI_HEAP_SAMPLE");
+    if (period && std::atoll(period) > 1) {
+        samplePeriod = std::atoll(period);
+    }
+    const char *path = ::getenv("CPI_HEAP_PROFILE");
+    if (path && std::strlen(path) < sizeof(outputPath)) {
+        std::strcpy(outputPath, path);
+        ::unsetenv("CPI_HEAP_PROFILE");
+    }
+    ownerPid = ::getpid();
+    enabled = true;
+}
+
+
+__attribute__((destructor)) void finish()
+{
+    if (!enabled || !outputPath[0] || ::getpid() != ownerPid) {
+        return;
+    }
+    inHook = true;
+    enabled = false;
+    writeSummary(outputPath);
+}
+
+}  // namespace
+
+
+extern "C" {
+
+void *malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    record(ptr, size);
+    return ptr;
+}
+
+
+void *calloc(size_t count, size_t size)
+{
+    void *ptr = __libc_calloc(count, size);
+    record(ptr, count * size);
+    return ptr;
+}
+
+
+void *realloc(void *ptr, size_t size)
+{
+    const size_t usable = ptr ? malloc_usable_size(ptr) : 0;
+    void *newPtr = __libc_realloc(ptr, size);
+    if (newPtr || size == 0) {
+        // moved or freed; the old block is still alive on failure
+        if (ptr) {
+            release(usable);
+        }
+        record(newPtr, size);
+    }
+    return newPtr;
+}
+
+
+void free(void *ptr)
+{
+    if (ptr) {
+        release(malloc_usable_size(ptr));
+    }
+    __libc_free(ptr);
+}
+
+
+void *memalign(size_t alignment, size_t size)
+{
+    void *ptr = __libc_memalign(alignment, size);
+    record(ptr, size);
+    return ptr;
+}
+
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    void *ptr = __libc_memalign(alignment, size);
+    record(ptr, size);
+    return ptr;
+}
+
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void *ptr = __libc_memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    record(ptr, size);
+    *memptr = ptr;
+    return 0;
+}
+
+
+void *valloc(size_t size)
+{
+    void *ptr = __libc_memalign(::sysconf(_SC_PAGESIZE), size);
+    record(ptr, size);
+    return ptr;
+}
+
+}  // extern "C"
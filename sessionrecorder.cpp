@@ -0,0 +1,32 @@
+#include "sessionrecorder.h"
+#include "print.h"
+#include <QtCore/QtCore>
+using namespace cpi;
+
+
+bool SessionRecorder::open(const QString &path)
+{
+    _file.setFileName(path);
+    if (!_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        print() << "File open error, " << path << endl;
+        return false;
+    }
+    _timer.start();
+    return true;
+}
+
+
+// {"delay": msecs, "input": "..."}, written as typed not to lose a session
+// ending abnormally
+void SessionRecorder::record(const QString &line)
+{
+    if (!_file.isOpen()) {
+        return;
+    }
+
+    QJsonObject obj;
+    obj.insert("delay", _timer.restart());
+    obj.insert("input", line);
+    _file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact) + "\n");
+    _file.flush();
+}
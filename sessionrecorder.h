@@ -0,0 +1,17 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+
+
+// Records the lines typed in the interactive mode with the delays between
+// them in JSON Lines, to be replayed by SessionReplayer
+class SessionRecorder {
+public:
+    bool open(const QString &path);
+    void record(const QString &line);
+
+private:
+    QFile _file;
+    QElapsedTimer _timer;  // since the last line
+};
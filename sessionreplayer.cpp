@@ -0,0 +1,325 @@
+#include "sessionreplayer.h"
+#include "global.h"
+#include "print.h"
+#include <QtCore/QtCore>
+#include <algorithm>
+#include <iostream>
+#ifdef Q_OS_WIN
+#include "ptyprocess_win.h"
+#else
+#include "ptyprocess.h"
+#endif
+using namespace cpi;
+
+// The interactive mode shows "cpi> " as soon as a line is entered, and
+// compiles it in the background; the result is printed over the prompt
+// ("\r     \r") and followed by the prompt again. An incomplete input is
+// continued at "...> ", and a question of a command waits at "[y/N] ".
+static const QByteArray Prompt = "cpi> ";
+static const QByteArray ContinuationPrompt = "...> ";
+static const QByteArray QuestionPrompt = "[y/N] ";
+static const QByteArray ResultMark = "\r     \r";
+
+
+int SessionReplayer::run(const QString &path, bool bench)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        print() << "File open error, " << path << endl;
+        return 1;
+    }
+
+    // {"delay": msecs, "input": "..."}
+    QList<Entry> entries;
+    for (const auto &line : file.readAll().split('\n')) {
+        if (line.trimmed().isEmpty()) {
+            continue;
+        }
+        QJsonObject obj = QJsonDocument::fromJson(line).object();
+        entries << Entry {obj.value("delay").toVariant().toLongLong(), obj.value("input").toString()};
+    }
+
+    PtyProcess cpi;
+    _timer.start();
+    _output.clear();
+    _arrivals.clear();
+    if (!cpi.start(QCoreApplication::applicationFilePath(), QStringList())) {
+        print() << "Failed to start " << QCoreApplication::applicationFilePath() << endl;
+        return 1;
+    }
+
+    // the banner and the first prompt; the echo of the terminal is turned
+    // off just after it
+    while (!_output.contains(Prompt)) {
+        if (!receive(cpi, !bench)) {
+            print() << "Failed to start the interactive mode" << endl;
+            return 1;
+        }
+    }
+    const qint64 startup = _timer.elapsed();
+    Sleep(100);
+    receive(cpi, !bench);
+    if (_typeAhead) {
+        return typeAhead(cpi, path, startup, entries, bench);
+    }
+
+    QList<Timing> timings;
+    for (const auto &entry : entries) {
+        if (cpi.state() != QProcess::Running || gQuitRequested) {
+            break;
+        }
+        if (!bench && !timings.isEmpty()) {
+            // at the pace typed, unless the previous line took longer
+            Sleep(std::max(entry.delay - timings.last().done, 0LL));
+        }
+        timings << replayLine(cpi, entry.input, !bench);
+    }
+    const bool died = (timings.count() < entries.count()) && !gQuitRequested;  // before the last line
+
+    if (cpi.state() == QProcess::Running) {
+        cpi.write(".quit\n");
+        if (!cpi.waitForFinished(5000)) {
+            cpi.kill();
+        }
+    }
+    if (!bench) {
+        receive(cpi, true);
+        std::cout << std::endl;
+    } else {
+        printReport(path, startup, timings);
+    }
+
+    // fails if a line was not processed, except the .quit ending cpi
+    int failures = died ? entries.count() - timings.count() : 0;
+    for (int i = 0; i < timings.count(); i++) {
+        const QString cmd = timings[i].input.trimmed();
+        const bool quit = (i == timings.count() - 1) && (cmd == ".quit" || cmd == ".q");
+        if (timings[i].done < 0 && !quit) {
+            failures++;
+        }
+    }
+    if (failures > 0 && !gQuitRequested) {
+        print() << ">>> replay failed: " << (died ? "cpi exited, " : "") << failures << " lines not processed" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+// Reads the output of cpi; false if it exited or timed out
+bool SessionReplayer::receive(PtyProcess &cpi, bool echo)
+{
+    const bool finished = cpi.waitForFinished(1);
+    const QByteArray out = cpi.readAll();
+    if (!out.isEmpty()) {
+        _output += out;
+        _arrivals << qMakePair(_output.size(), _timer.elapsed());
+        if (echo) {
+            std::cout.write(out.constData(), out.size());
+            std::cout.flush();
+        }
+    }
+    qApp->processEvents();
+    return !finished && !gQuitRequested && _timer.elapsed() < _lineTimeout;
+}
+
+
+// Msecs when the byte at the offset was read
+qint64 SessionReplayer::arrivalTime(qsizetype offset) const
+{
+    for (const auto &arrival : _arrivals) {
+        if (offset < arrival.first) {
+            return arrival.second;
+        }
+    }
+    return -1;
+}
+
+
+// Sends the line and waits until it is processed
+SessionReplayer::Timing SessionReplayer::replayLine(PtyProcess &cpi, const QString &input, bool echo)
+{
+    Timing timing {input};
+    _output.clear();
+    _arrivals.clear();
+    _timer.restart();
+    cpi.write(input.toUtf8());
+
+    // cpi echoes the line, translated to CRLF by the terminal
+    const qsizetype echoLength = input.toUtf8().replace("\n", "\r\n").size();
+    const QString cmd = input.trimmed();
+    qsizetype promptPos = -1;
+    qsizetype markPos = -1;
+
+    while (receive(cpi, echo)) {
+        if (promptPos < 0) {
+            const qsizetype pos = _output.indexOf(Prompt, echoLength);
+            const qsizetype contPos = _output.indexOf(ContinuationPrompt, echoLength);
+            const qsizetype questionPos = _output.indexOf(QuestionPrompt, echoLength);
+            if (pos < 0 && contPos < 0 && questionPos < 0) {
+                continue;
+            }
+
+            const qsizetype size = _output.size();
+            promptPos = std::min({(pos < 0) ? size : pos, (contPos < 0) ? size : contPos, (questionPos < 0) ? size : questionPos});
+            timing.prompt = arrivalTime(promptPos);
+            if (promptPos > echoLength) {
+                timing.output = arrivalTime(echoLength);  // of a command
+            }
+
+            // an answer, a command, or a line of an incomplete input, two
+            // blank ones discarding it, are done at the prompt
+            _blankLines = (_continued && cmd.isEmpty()) ? _blankLines + 1 : 0;
+            const bool discarded = _continued && _blankLines >= 2;
+            const bool command = !_continued && (cmd.startsWith('.') || cmd == "?");
+            const bool answer = _question;
+            _continued = (promptPos == contPos);
+            _question = (promptPos == questionPos);
+            if (_continued || _question || discarded || command || answer) {
+                timing.done = timing.prompt;
+                break;
+            }
+            _blankLines = 0;
+        }
+
+        // the result of the code compiled in the background
+        if (markPos < 0) {
+            markPos = _output.indexOf(ResultMark, promptPos);
+            if (markPos < 0) {
+                continue;
+            }
+        }
+        const qsizetype resultPos = markPos + ResultMark.size();
+        const qsizetype nextPromptPos = _output.indexOf(Prompt, resultPos);
+        if (nextPromptPos >= 0) {
+            if (nextPromptPos > resultPos) {
+                timing.output = arrivalTime(resultPos);
+            }
+            timing.done = arrivalTime(nextPromptPos);
+            break;
+        }
+    }
+
+    if (timing.done < 0 && cpi.state() == QProcess::Running && !gQuitRequested) {
+        print() << ">>> no prompt in " << _lineTimeout / 1000 << " s after: " << cmd << endl;
+    }
+    return timing;
+}
+
+
+// Sends the lines at the pace recorded without waiting for the previous
+// ones to be processed, so that they are typed ahead and compiled together
+// as by a fast typist, then .quit, which cpi exits at after processing them
+int SessionReplayer::typeAhead(PtyProcess &cpi, const QString &path, qint64 startup, const QList<Entry> &entries, bool bench)
+{
+    int exitCode = -1;
+    QObject::connect(&cpi, &PtyProcess::finished, [&exitCode](int code) { exitCode = code; });
+    _output.clear();
+    _arrivals.clear();
+
+    QElapsedTimer clock;
+    clock.start();
+    qint64 sendTime = 0;  // of the next line
+    bool quit = false;  // by a line of the session
+    int sent = 0;
+    for (const auto &entry : entries) {
+        if (sent > 0) {
+            sendTime += entry.delay;
+        }
+        _timer.restart();
+        while (clock.elapsed() < sendTime && receive(cpi, !bench)) { }
+        if (cpi.state() != QProcess::Running || gQuitRequested) {
+            break;
+        }
+        cpi.write(entry.input.toUtf8());
+        sent++;
+
+        const QString cmd = entry.input.trimmed();
+        if (cmd == ".quit" || cmd == ".q") {
+            quit = true;
+            break;
+        }
+    }
+    const qint64 lastSent = clock.elapsed();
+
+    // the time limit is of the lines typed ahead all
+    if (!quit && cpi.state() == QProcess::Running) {
+        cpi.write(".quit\n");
+    }
+    _timer.restart();
+    while (receive(cpi, !bench)) { }
+    const bool timedOut = (cpi.state() == QProcess::Running);
+    if (timedOut) {
+        cpi.kill();
+    }
+    const qint64 done = clock.elapsed();
+
+    if (!bench) {
+        std::cout << std::endl;
+    } else {
+        print() << ">>> type-ahead replay of " << path << " (" << sent << " lines, startup " << startup << " ms)" << endl;
+        print() << QString(" results %1, last line sent %2 ms, done %3 ms (%4 ms after the last line)")
+                       .arg(_output.count(ResultMark))
+                       .arg(lastSent)
+                       .arg(done)
+                       .arg(done - lastSent)
+                << endl;
+    }
+
+    if (gQuitRequested) {
+        return 0;
+    }
+    if (timedOut) {
+        print() << ">>> replay failed: not processed in " << _lineTimeout / 1000 << " s after the last line" << endl;
+        return 1;
+    }
+    if (sent < entries.count() && !quit) {
+        print() << ">>> replay failed: cpi exited, " << entries.count() - sent << " lines not sent" << endl;
+        return 1;
+    }
+    if (exitCode != 0) {
+        print() << ">>> replay failed: cpi exited with " << exitCode << endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+static QString formatMsecs(qint64 msecs)
+{
+    return (msecs < 0) ? QString("-") : QString::number(msecs);
+}
+
+
+void SessionReplayer::printReport(const QString &path, qint64 startup, const QList<Timing> &timings) const
+{
+    print() << ">>> replay of " << path << " (" << timings.count() << " lines, startup " << startup << " ms)" << endl;
+    print() << "  line  prompt ms  output ms    done ms  input" << endl;
+
+    QList<qint64> dones;
+    for (int i = 0; i < timings.count(); i++) {
+        const Timing &timing = timings[i];
+        QString input = timing.input.trimmed().replace('\n', " ");
+        if (input.length() > 40) {
+            input = input.left(37) + "...";
+        }
+        print() << QString(" %1  %2  %3  %4  %5").arg(i + 1, 5).arg(formatMsecs(timing.prompt), 9).arg(formatMsecs(timing.output), 9).arg(formatMsecs(timing.done), 9).arg(input) << endl;
+        if (timing.done >= 0) {
+            dones << timing.done;
+        }
+    }
+
+    if (!dones.isEmpty()) {
+        std::sort(dones.begin(), dones.end());
+        qint64 total = 0;
+        for (qint64 done : dones) {
+            total += done;
+        }
+        print() << QString(" done  total %1 ms, median %2 ms, p90 %3 ms, max %4 ms")
+                       .arg(total)
+                       .arg(dones[dones.count() / 2])
+                       .arg(dones[std::min<qsizetype>(dones.count() * 9 / 10, dones.count() - 1)])
+                       .arg(dones.last())
+                << endl;
+    }
+}
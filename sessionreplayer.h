@@ -0,0 +1,46 @@
+#pragma once
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+class PtyProcess;
+
+
+// Replays a session recorded by SessionRecorder through the interactive
+// mode of cpi on a pseudo-terminal, and reports the latency of each line
+class SessionReplayer {
+public:
+    int run(const QString &path, bool bench);
+    void setLineTimeout(int msecs) { _lineTimeout = msecs; }
+    void setTypeAhead(bool typeAhead) { _typeAhead = typeAhead; }
+
+private:
+    struct Entry {
+        qint64 delay {0};  // msecs after the previous line
+        QString input;
+    };
+
+    struct Timing {
+        QString input;
+        qint64 prompt {-1};  // msecs until the prompt is shown again
+        qint64 output {-1};  // msecs until the first output of the line
+        qint64 done {-1};  // msecs until the line is processed
+    };
+
+    bool receive(PtyProcess &cpi, bool echo);
+    qint64 arrivalTime(qsizetype offset) const;
+    Timing replayLine(PtyProcess &cpi, const QString &input, bool echo);
+    int typeAhead(PtyProcess &cpi, const QString &path, qint64 startup, const QList<Entry> &entries, bool bench);
+    void printReport(const QString &path, qint64 startup, const QList<Timing> &timings) const;
+
+    int _lineTimeout {120000};  // msecs
+    bool _typeAhead {false};  // lines sent without waiting for the previous ones
+    QElapsedTimer _timer;  // since the line was sent
+    QByteArray _output;  // of cpi since the line was sent
+    QList<QPair<qsizetype, qint64>> _arrivals;  // end offset of each read, and msecs
+    bool _continued {false};  // the input is incomplete
+    int _blankLines {0};  // in the incomplete input
+    bool _question {false};  // a command asks to answer
+};
@@ -0,0 +1,175 @@
+#include "stableenvironment.h"
+#include "global.h"
+#include <QtCore/QtCore>
+#include <cmath>
+#include <cstdio>
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#include <sys/personality.h>
+#endif
+using namespace cpi;
+
+constexpr double NoisyVariation = 0.05;  // coefficient of variation
+
+
+static QByteArray readFile(const QString &path)
+{
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) ? file.readAll().trimmed() : QByteArray();
+}
+
+
+// "2-3,5" -> 2, 3, 5
+static QList<int> parseCpuList(const QString &str)
+{
+    QList<int> cpus;
+    for (const auto &range : str.split(',', SkipEmptyParts)) {
+        bool ok1 = false;
+        bool ok2 = false;
+        int first = range.section('-', 0, 0).trimmed().toInt(&ok1);
+        int last = range.section('-', -1).trimmed().toInt(&ok2);
+        if (!ok1 || !ok2 || first < 0 || last < first) {
+            return QList<int>();
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus << cpu;
+        }
+    }
+    return cpus;
+}
+
+
+StableEnvironment::StableEnvironment()
+{
+#ifdef Q_OS_LINUX
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        return;
+    }
+
+    // STABLE_CPUS, isolated CPUs (isolcpus=) or the last allowed CPU
+    QList<int> cpus = parseCpuList(conf->value("STABLE_CPUS").toString());
+    if (cpus.isEmpty()) {
+        cpus = parseCpuList(QString::fromLatin1(readFile("/sys/devices/system/cpu/isolated")));
+    }
+    if (cpus.isEmpty()) {
+        for (int cpu = CPU_SETSIZE - 1; cpu >= 0; cpu--) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus << cpu;
+                break;
+            }
+        }
+    }
+
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+            _cpus << cpu;
+        }
+    }
+    _noAslr = !conf->value("STABLE_ASLR", false).toBool();
+#endif
+}
+
+
+void StableEnvironment::printWarnings() const
+{
+    QStringList cpus;
+    for (int cpu : _cpus) {
+        cpus << QString::number(cpu);
+    }
+    std::fprintf(stderr, ">>> stable mode: CPU %s, ASLR %s\n", cpus.isEmpty() ? "not pinned" : qUtf8Printable(cpus.join(",")), _noAslr ? "off" : "on");
+
+#ifdef Q_OS_LINUX
+    for (int cpu : _cpus) {
+        const QByteArray governor = readFile(QString("/sys/devices/system/cpu/cpu%1/cpufreq/scaling_governor").arg(cpu));
+        if (!governor.isEmpty() && governor != "performance") {
+            std::fprintf(stderr, " warning: scaling governor of CPU %d is '%s', not 'performance'\n", cpu, governor.constData());
+        }
+    }
+
+    if (readFile("/sys/devices/system/cpu/intel_pstate/no_turbo") == "0"
+        || readFile("/sys/devices/system/cpu/cpufreq/boost") == "1") {
+        std::fprintf(stderr, " warning: turbo boost is enabled\n");
+    }
+#else
+    std::fprintf(stderr, " warning: CPU pinning and ASLR are not controlled on this platform\n");
+#endif
+    std::fflush(stderr);
+}
+
+
+std::function<void()> StableEnvironment::childProcessModifier() const
+{
+#ifdef Q_OS_LINUX
+    if (_cpus.isEmpty() && !_noAslr) {
+        return nullptr;
+    }
+
+    // prepared here, only async-signal-safe calls in the child
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : _cpus) {
+        CPU_SET(cpu, &set);
+    }
+    const bool pin = !_cpus.isEmpty();
+    const bool noAslr = _noAslr;
+
+    return [set, pin, noAslr]() {
+        if (pin) {
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+        if (noAslr) {
+            // takes effect at exec
+            int persona = personality(0xffffffff);
+            if (persona >= 0) {
+                personality(persona | ADDR_NO_RANDOMIZE);
+            }
+        }
+    };
+#else
+    return nullptr;
+#endif
+}
+
+
+static void printTimes(const char *label, const QList<double> &times, bool &noisy)
+{
+    if (times.isEmpty()) {
+        return;
+    }
+
+    double sum = 0;
+    double min = times.first();
+    double max = times.first();
+    for (double t : times) {
+        sum += t;
+        min = std::min(min, t);
+        max = std::max(max, t);
+    }
+    const double mean = sum / times.count();
+
+    double squares = 0;
+    for (double t : times) {
+        squares += (t - mean) * (t - mean);
+    }
+    const double stddev = (times.count() > 1) ? std::sqrt(squares / (times.count() - 1)) : 0;
+    const double cv = (mean > 0) ? stddev / mean : 0;
+    noisy |= (cv > NoisyVariation);
+
+    std::fprintf(stderr, " %-10s mean %.3f ms  stddev %.3f ms  min %.3f ms  max %.3f ms  CV %.1f%%\n",
+        label, mean, stddev, min, max, cv * 100);
+}
+
+
+void StableEnvironment::printStatistics(const QList<double> &wallTimes, const QList<double> &cpuTimes, int warmups)
+{
+    bool noisy = false;
+    std::fprintf(stderr, ">>> %lld runs after %d warm-up%s\n", (long long)wallTimes.count(), warmups, (warmups == 1) ? "" : "s");
+    printTimes("wall time", wallTimes, noisy);
+    printTimes("CPU time", cpuTimes, noisy);
+    if (noisy) {
+        std::fprintf(stderr, " warning: the variation exceeds %.0f%%, the timings are noisy\n", NoisyVariation * 100);
+    }
+    std::fflush(stderr);
+}
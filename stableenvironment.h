@@ -0,0 +1,23 @@
+#pragma once
+#include <QList>
+#include <QString>
+#include <functional>
+
+
+// Environment for reproducible timings; pins the executed program to a CPU
+// and disables ASLR (Linux), and checks the sources of noise
+class StableEnvironment {
+public:
+    StableEnvironment();
+
+    QList<int> cpus() const { return _cpus; }
+    bool isAslrDisabled() const { return _noAslr; }
+    void printWarnings() const;
+    std::function<void()> childProcessModifier() const;
+
+    static void printStatistics(const QList<double> &wallTimes, const QList<double> &cpuTimes, int warmups);
+
+private:
+    QList<int> _cpus;  // CPUs to pin, empty if not pinned
+    bool _noAslr {false};
+};
@@ -0,0 +1,84 @@
+#include "symbolizer.h"
+#include <QtCore/QtCore>
+#include <algorithm>
+
+
+// Executables not position independent are symbolized by the addresses as is
+static bool isFixedAddressExecutable(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray header = file.read(18);
+    return header.startsWith("\x7f" "ELF") && header.size() == 18 && header.at(16) == 2;  // ET_EXEC
+}
+
+
+// Return addresses are to be given minus 1, to point into the call
+void Symbolizer::resolve(const QList<quint64> &addresses)
+{
+    // addresses in each file
+    QHash<QString, QList<QPair<quint64, quint64>>> fileAddresses;
+    for (quint64 address : addresses) {
+        if (_symbols.contains(address)) {
+            continue;
+        }
+
+        // the latest mapping of the address
+        auto it = std::find_if(_mappings.rbegin(), _mappings.rend(), [&](const Mapping &m) {
+            return address >= m.address && address < m.address + m.length;
+        });
+        if (it == _mappings.rend()) {
+            _symbols.insert(address, Symbol {"0x" + QString::number(address, 16)});
+        } else if (it->path.startsWith('[')) {
+            _symbols.insert(address, Symbol {it->path});  // [vdso]
+        } else {
+            const quint64 fileAddress = isFixedAddressExecutable(it->path) ? address : address - it->address + it->offset;
+            fileAddresses[it->path] << qMakePair(address, fileAddress);
+            _symbols.insert(address, Symbol {"??"});
+        }
+    }
+
+    for (auto it = fileAddresses.cbegin(); it != fileAddresses.cend(); ++it) {
+        QByteArray input;
+        for (const auto &pair : it.value()) {
+            input += "0x" + QByteArray::number(pair.second, 16) + "\n";
+        }
+
+        QProcess proc;
+        proc.start("addr2line", {"-f", "-C", "-e", it.key()});
+        proc.write(input);
+        proc.closeWriteChannel();
+        proc.waitForFinished(-1);
+        const QStringList output = QString::fromLocal8Bit(proc.readAllStandardOutput()).split('\n');
+
+        // function and "file:line" for each address
+        const QString library = "[" + QFileInfo(it.key()).fileName() + "]";
+        for (int i = 0; i < it.value().count(); i++) {
+            Symbol symbol;
+            symbol.function = output.value(i * 2);
+            if (symbol.function.isEmpty() || symbol.function == "??") {
+                symbol.function = library;
+            }
+            const QString location = output.value(i * 2 + 1).section(' ', 0, 0);  // " (discriminator N)"
+            const int colon = location.lastIndexOf(':');
+            if (colon > 0 && !location.startsWith("??")) {
+                symbol.file = location.left(colon);
+                if (symbol.file.endsWith("/<stdin>")) {
+                    symbol.file = "<stdin>";  // prefixed by the working directory
+                }
+                symbol.line = location.mid(colon + 1).toInt();
+            }
+            _symbols.insert(it.value()[i].first, symbol);
+        }
+    }
+}
+
+
+const Symbolizer::Symbol &Symbolizer::symbol(quint64 address) const
+{
+    static const Symbol unknown {"??"};
+    auto it = _symbols.constFind(address);
+    return (it != _symbols.cend()) ? it.value() : unknown;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <vector>
+
+
+// Functions and source lines of the addresses in the executable mappings
+// of a process, resolved by addr2line
+class Symbolizer {
+public:
+    struct Mapping {
+        quint64 address {0};
+        quint64 length {0};
+        quint64 offset {0};  // in the file
+        QString path;
+    };
+
+    struct Symbol {
+        QString function;
+        QString file;
+        int line {0};
+    };
+
+    void addMapping(const Mapping &mapping) { _mappings.push_back(mapping); }
+    void resolve(const QList<quint64> &addresses);
+    const Symbol &symbol(quint64 address) const;
+
+private:
+    std::vector<Mapping> _mappings;
+    QHash<quint64, Symbol> _symbols;
+};
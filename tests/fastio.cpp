@@ -0,0 +1,81 @@
+#include <cpi/fastio.h>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+template <typename T>
+static void check(const char *what, const T &actual, const T &expected)
+{
+    if (!(actual == expected)) {
+        std::cout << "NG: " << what << std::endl;
+        failures++;
+    }
+}
+
+
+int main()
+{
+    const char *csv = "name,price,count\r\n"
+                      "apple,1.5,3\r\n"
+                      "orange,0.8,10\n";
+
+    double total = 0;
+    int count = 0;
+    for (auto line : cpi::lines(csv)) {
+        std::vector<std::string_view> f;
+        cpi::split(line, ',', f);
+        check("fields", f.size(), std::size_t(3));
+        if (count++ > 0) {
+            total += cpi::to<double>(f[1]) * cpi::to<int>(f[2]);
+        }
+    }
+    check("lines", count, 3);
+    check("total", total, 12.5);
+
+    // longer than a vector register, not to be found only by the scalar tail
+    const std::string wide = "0123456789abcdefghijklmnopqrstuvwxyz0123456789,after\n"
+                             "next";
+    std::vector<std::string_view> all;
+    std::vector<bool> ends;
+    cpi::forEachField(wide, ',', [&](std::string_view field, bool endOfLine) {
+        all.push_back(field);
+        ends.push_back(endOfLine);
+    });
+    check("forEachField", all, std::vector<std::string_view> {wide.substr(0, 46), "after", "next"});
+    check("endOfLine", ends, std::vector<bool> {false, true, true});
+    check("findAny", cpi::findAny(wide.data(), wide.data() + wide.size(), '\n', '#') - wide.data(), std::ptrdiff_t(52));
+
+    check("to<int>", cpi::to<int>(" +42"), 42);
+    check("to<int> negative", cpi::to<int>("-7"), -7);
+    check("to<int> two signs", cpi::to<int>("+-5", 99), 99);
+    check("to<int> empty", cpi::to<int>("", 99), 99);
+
+    const char *path = "cpi_fastio_test.txt";
+    if (FILE *fp = std::fopen(path, "wb")) {
+        std::fputs(csv, fp);
+        std::fclose(fp);
+    }
+    {
+        cpi::FileView file(path);
+        check("FileView", file.view(), std::string_view(csv));
+
+        cpi::FileView moved;
+        moved = std::move(file);
+        check("FileView moved", moved.view(), std::string_view(csv));
+        check("FileView moved from", file.isOpen(), false);
+
+        cpi::FileView unopened;
+        moved = std::move(unopened);
+        check("FileView unopened", moved.isOpen(), false);
+    }
+    std::remove(path);
+    check("FileView missing", cpi::FileView(path).isOpen(), false);
+
+    std::cout << (failures ? "fastio: failed" : "fastio: ok") << std::endl;
+    return failures ? 1 : 0;
+}
+
+// FastIO: true
@@ -0,0 +1,11 @@
+import std;
+
+int main()
+{
+    std::vector<int> v {3, 1, 2};
+    std::ranges::sort(v);
+    std::println("{}", v);
+    return 0;
+}
+
+// CompileOptions: -std=c++23
@@ -0,0 +1,12 @@
+#include <iostream>
+
+int square(int n);
+int cube(int n);
+
+int main()
+{
+    std::cout << square(3) << " " << cube(3) << std::endl;
+    return 0;
+}
+
+// Sources: sources/*.cpp
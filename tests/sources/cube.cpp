@@ -0,0 +1,6 @@
+int square(int n);
+
+int cube(int n)
+{
+    return square(n) * n;
+}
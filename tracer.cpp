@@ -0,0 +1,117 @@
+#include "tracer.h"
+#include <QtCore/QtCore>
+#include <atomic>
+
+
+static qint64 currentThreadNumber()
+{
+    static std::atomic<qint64> counter {0};
+    thread_local qint64 number = ++counter;
+    return number;
+}
+
+
+Tracer &Tracer::globalInstance()
+{
+    static Tracer global;
+    return global;
+}
+
+
+void Tracer::start(const QString &path)
+{
+    _path = path;
+    _timer.start();
+    setProcessName(QCoreApplication::applicationPid(), "cpi");
+}
+
+
+qint64 Tracer::now() const
+{
+    return _timer.isValid() ? _timer.nsecsElapsed() / 1000 : 0;
+}
+
+
+void Tracer::addSpan(const QString &name, qint64 begin, qint64 duration, qint64 pid, const QString &category)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    QJsonObject event {
+        {"name", name},
+        {"cat", category},
+        {"ph", "X"},
+        {"ts", begin},
+        {"dur", duration},
+        {"pid", pid ? pid : QCoreApplication::applicationPid()},
+        {"tid", pid ? 1 : currentThreadNumber()},
+    };
+
+    QMutexLocker locker(&_mutex);
+    _events.append(event);
+}
+
+
+void Tracer::setProcessName(qint64 pid, const QString &name)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    QJsonObject event {
+        {"name", "process_name"},
+        {"ph", "M"},
+        {"pid", pid},
+        {"args", QJsonObject {{"name", name}}},
+    };
+
+    QMutexLocker locker(&_mutex);
+    _events.append(event);
+}
+
+
+// Merges the events of clang's -ftime-trace, shifted by the given offset
+void Tracer::addClangTimeTrace(const QString &path, qint64 pid, qint64 offset)
+{
+    QFile file(path);
+    if (!isEnabled() || !file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    const QJsonArray array = QJsonDocument::fromJson(file.readAll()).object().value("traceEvents").toArray();
+    QMutexLocker locker(&_mutex);
+
+    for (const auto &v : array) {
+        QJsonObject event = v.toObject();
+        if (event.value("ph").toString() != "X") {
+            continue;  // metadata and counters
+        }
+        event["ts"] = (qint64)event.value("ts").toDouble() + offset;
+        event["pid"] = pid;
+        event["cat"] = "compiler";
+        _events.append(event);
+    }
+}
+
+
+bool Tracer::save()
+{
+    if (!isEnabled()) {
+        return false;
+    }
+
+    QFile file(_path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to write the trace file:" << _path;
+        return false;
+    }
+
+    QMutexLocker locker(&_mutex);
+    QJsonObject trace {
+        {"traceEvents", _events},
+        {"displayTimeUnit", "ms"},
+    };
+    file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QMutex>
+#include <QString>
+
+
+// Chrome/Perfetto trace of a cpi run
+class Tracer {
+public:
+    static Tracer &globalInstance();
+
+    void start(const QString &path);
+    bool isEnabled() const { return !_path.isEmpty(); }
+    qint64 now() const;  // usecs since start
+    void addSpan(const QString &name, qint64 begin, qint64 duration, qint64 pid = 0, const QString &category = "cpi");
+    void setProcessName(qint64 pid, const QString &name);
+    void addClangTimeTrace(const QString &path, qint64 pid, qint64 offset);
+    bool save();
+
+private:
+    Tracer() { }
+
+    QString _path;
+    QElapsedTimer _timer;
+    QJsonArray _events;
+    QMutex _mutex;
+};
+
+
+class TraceSpan {
+public:
+    explicit TraceSpan(const char *name) :
+        _name(name), _begin(Tracer::globalInstance().isEnabled() ? Tracer::globalInstance().now() : -1) { }
+    ~TraceSpan() { finish(); }
+
+    void finish()
+    {
+        if (_begin >= 0) {
+            Tracer::globalInstance().addSpan(_name, _begin, Tracer::globalInstance().now() - _begin);
+            _begin = -1;
+        }
+    }
+
+private:
+    const char *_name;
+    qint64 _begin;
+};